@@ -16,6 +16,8 @@
  */
 #include "bitbox.h"
 #include "chip.h"
+#include "cycles.h"
+#include "profile.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -46,6 +48,11 @@ uint8_t chip_instrument_for_next_note_for_player[CHIP_PLAYERS] CCM_MEMORY;
 
 // a song is made out of a sequence of song commands (see song_cmd_t).
 uint8_t chip_song_cmd[MAX_SONG_LENGTH];
+
+// Which jump targets can be chosen randomly without getting stuck, see chip_instrument_analyze.
+uint16_t chip_instrument_safe_jumps[16] CCM_MEMORY;
+uint16_t chip_track_safe_jumps[MAX_TRACKS][CHIP_PLAYERS] CCM_MEMORY;
+uint16_t chip_song_safe_jumps CCM_MEMORY;
 uint8_t chip_song_cmd_index CCM_MEMORY;
 uint8_t chip_song_players CCM_MEMORY;
 uint8_t chip_song_volume CCM_MEMORY;
@@ -56,6 +63,13 @@ uint8_t song_speed CCM_MEMORY;
 uint8_t chip_song_variable_A CCM_MEMORY;
 uint8_t chip_song_variable_B CCM_MEMORY;
 uint8_t chip_song_squarify CCM_MEMORY;
+uint8_t chip_song_loops CCM_MEMORY;
+uint8_t chip_sound_off CCM_MEMORY;
+
+uint8_t chip_tap_enabled;
+uint16_t chip_tap[CHIP_TAP_LEN];
+volatile uint32_t chip_tap_written;
+uint8_t chip_tap_volume[CHIP_PLAYERS];
 
 
 // At each sample the phase is incremented by frequency/4. It is then used to
@@ -98,6 +112,207 @@ static const int8_t sine_table[] = { // 16 values per row, 64 total
     ASSERT(duty != 0); \
     ASSERT(phase < duty)
 
+// This is a simple noise generator based on an LFSR (linear feedback shift
+// register). It is fast and simple and works reasonably well for audio.
+static uint32_t noiseseed = 1;
+static uint32_t rednoise = 0;
+static uint32_t violetnoise = 0;
+
+static inline void gen_noise()
+{   // Advances the noise generators by one sample.
+    uint32_t newbit;
+    newbit = 0;
+    if (noiseseed & 0x80000000L) newbit ^= 1;
+    if (noiseseed & 0x01000000L) newbit ^= 1;
+    if (noiseseed & 0x00000040L) newbit ^= 1;
+    if (noiseseed & 0x00000200L) newbit ^= 1;
+    noiseseed = (noiseseed << 1) | newbit;
+    rednoise = 3*rednoise/4 + (noiseseed&255)/4;
+    // violet should be the derivative of white noise, but that wasn't nice:
+    // this gives some higher freqs, and a metallic ring too:
+    violetnoise = violetnoise/6 + ((noiseseed&255)-128); 
+}
+
+#if CHIP_LOOP_CACHE_BYTES
+// Each cached loop is a list of blocks, one per sound buffer, which holds the oscillators
+// right before the samples were generated (this fully determines the samples, since
+// loops which use noise are never cached) followed by the samples themselves.
+#define CHIP_LOOP_CACHE_ENTRIES 8
+
+typedef enum
+{   LoopCacheIdle = 0,
+    LoopCacheRecording,
+    LoopCacheReplaying,
+} chip_loop_cache_state_t;
+
+struct chip_loop_entry
+{   uint32_t hash; // of the chip state at the start of the loop
+    uint32_t offset; // in words into chip_loop_cache_pool
+    uint16_t block_count;
+    uint16_t block_len; // number of samples in each block
+};
+
+uint32_t chip_loop_cache_budget = CHIP_LOOP_CACHE_BYTES;
+uint32_t chip_loop_cache_hits;
+uint32_t chip_loop_cache_misses;
+
+static uint32_t chip_loop_cache_pool[CHIP_LOOP_CACHE_BYTES/4];
+static uint32_t chip_loop_cache_used; // in words, only counting finished entries
+static struct chip_loop_entry chip_loop_entry[CHIP_LOOP_CACHE_ENTRIES];
+static uint8_t chip_loop_entry_count;
+static chip_loop_cache_state_t chip_loop_state;
+// the entry being recorded (always at index chip_loop_entry_count) or replayed:
+static uint8_t chip_loop_current;
+static uint16_t chip_loop_block;
+// set if something non-deterministic happened while recording:
+static uint8_t chip_loop_spoiled;
+
+#define CHIP_LOOP_BLOCK_WORDS(len) \
+    ((sizeof(struct oscillator)*CHIP_PLAYERS + 2*(len) + 3)/4)
+
+void chip_loop_cache_clear()
+{   // Forgets all recorded loops.
+    chip_loop_cache_used = 0;
+    chip_loop_entry_count = 0;
+    chip_loop_state = LoopCacheIdle;
+}
+
+static uint32_t chip_loop_hash(uint32_t hash, const void *data, int size)
+{   // FNV-1a, good enough to find candidates; blocks are checked exactly when replaying.
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (size--)
+        hash = (hash ^ *bytes++) * 16777619u;
+    return hash;
+}
+
+static void chip_loop_cache_enter()
+{   // Called when a track loop (re)starts, i.e. at track_pos == 0.
+    switch (chip_loop_state)
+    {   case LoopCacheRecording:
+            if (chip_loop_spoiled || !chip_loop_block)
+                break;
+            // The previous loop was recorded successfully, keep it:
+            chip_loop_entry[chip_loop_current].block_count = chip_loop_block;
+            chip_loop_cache_used += chip_loop_block *
+                CHIP_LOOP_BLOCK_WORDS(chip_loop_entry[chip_loop_current].block_len);
+            ++chip_loop_entry_count;
+            break;
+        case LoopCacheReplaying:
+            if (chip_loop_block == chip_loop_entry[chip_loop_current].block_count)
+                ++chip_loop_cache_hits;
+            else
+                ++chip_loop_cache_misses;
+            break;
+        default:
+            break;
+    }
+    chip_loop_state = LoopCacheIdle;
+    if (!chip_loop_cache_budget)
+        return;
+
+    uint32_t hash = 2166136261u;
+    hash = chip_loop_hash(hash, chip_player, sizeof(chip_player));
+    hash = chip_loop_hash(hash, oscillator, sizeof(oscillator));
+    hash = chip_loop_hash(hash, chip_instrument_for_next_note_for_player, CHIP_PLAYERS);
+    uint8_t song_state[8] =
+    {   song_transpose, song_wait, song_speed, chip_track_playtime,
+        chip_volume, chip_song_cmd_index, chip_song_variable_A, chip_song_variable_B
+    };
+    hash = chip_loop_hash(hash, song_state, sizeof(song_state));
+
+    chip_loop_block = 0;
+    for (int e=0; e<chip_loop_entry_count; ++e)
+    if (chip_loop_entry[e].hash == hash)
+    {   chip_loop_current = e;
+        chip_loop_state = LoopCacheReplaying;
+        return;
+    }
+    ++chip_loop_cache_misses;
+    if (chip_loop_entry_count >= CHIP_LOOP_CACHE_ENTRIES)
+        chip_loop_cache_clear();
+    chip_loop_current = chip_loop_entry_count;
+    chip_loop_entry[chip_loop_current].hash = hash;
+    chip_loop_entry[chip_loop_current].offset = chip_loop_cache_used;
+    chip_loop_entry[chip_loop_current].block_len = 0;
+    chip_loop_spoiled = 0;
+    chip_loop_state = LoopCacheRecording;
+}
+
+static inline uint32_t *chip_loop_cache_block(uint16_t block)
+{   struct chip_loop_entry *entry = &chip_loop_entry[chip_loop_current];
+    return chip_loop_cache_pool + entry->offset + block*CHIP_LOOP_BLOCK_WORDS(entry->block_len);
+}
+
+static int chip_loop_cache_replay(uint16_t *buffer, int len)
+{   // Returns 1 if the buffer was filled from the cache, 0 if it still needs to be synthesized.
+    if (chip_loop_state != LoopCacheReplaying)
+        return 0;
+    struct chip_loop_entry *entry = &chip_loop_entry[chip_loop_current];
+    const uint32_t *block = chip_loop_cache_block(chip_loop_block);
+    if (chip_loop_block >= entry->block_count || entry->block_len != len ||
+        memcmp(block, oscillator, sizeof(oscillator)))
+    {   // Something changed (e.g. an edit, or a note played over the song), so the rest
+        // of this loop can't come from the cache.
+        ++chip_loop_cache_misses;
+        chip_loop_state = LoopCacheIdle;
+        return 0;
+    }
+    ++chip_loop_block;
+    memcpy(buffer, (const uint8_t *)block + sizeof(oscillator), 2*len);
+    // Leave the oscillators and noise exactly as gen_sample() would have:
+    for (int i=0; i<CHIP_PLAYERS; ++i)
+    if (oscillator[i].volume)
+        oscillator[i].phase += (oscillator[i].freq / 4) * len;
+    for (int i=0; i<len; ++i)
+        gen_noise();
+    return 1;
+}
+
+static void chip_loop_cache_record_oscillators(int len)
+{   // Starts a new block for the current loop, before its samples are generated.
+    if (chip_loop_state != LoopCacheRecording || chip_loop_spoiled)
+        return;
+    struct chip_loop_entry *entry = &chip_loop_entry[chip_loop_current];
+    if (!entry->block_len)
+        entry->block_len = len;
+    uint32_t budget = chip_loop_cache_budget < CHIP_LOOP_CACHE_BYTES ?
+        chip_loop_cache_budget : CHIP_LOOP_CACHE_BYTES;
+    if (entry->block_len != len || chip_loop_block + 1 == 65536)
+    {   chip_loop_spoiled = 1;
+        return;
+    }
+    if (4*(entry->offset + (chip_loop_block + 1)*CHIP_LOOP_BLOCK_WORDS(len)) > budget)
+    {   if (!entry->offset || 4*(chip_loop_block + 1)*CHIP_LOOP_BLOCK_WORDS(len) > budget)
+        {   chip_loop_spoiled = 1;
+            return;
+        }
+        // Out of room; drop the older loops in favor of this one:
+        memmove(chip_loop_cache_pool, chip_loop_cache_pool + entry->offset,
+            4*chip_loop_block*CHIP_LOOP_BLOCK_WORDS(len));
+        chip_loop_entry[0] = *entry;
+        chip_loop_entry[0].offset = 0;
+        chip_loop_current = 0;
+        chip_loop_entry_count = 0;
+        chip_loop_cache_used = 0;
+    }
+    for (int i=0; i<CHIP_PLAYERS; ++i)
+    if (oscillator[i].volume && (oscillator[i].waveform >= WfNoise || oscillator[i].static_amt))
+    {   // noise isn't part of the hashed state, so don't pretend to be able to replay it:
+        chip_loop_spoiled = 1;
+        return;
+    }
+    memcpy(chip_loop_cache_block(chip_loop_block), oscillator, sizeof(oscillator));
+}
+
+static void chip_loop_cache_record_samples(const uint16_t *buffer, int len)
+{   // Finishes the block started in chip_loop_cache_record_oscillators.
+    if (chip_loop_state != LoopCacheRecording || chip_loop_spoiled)
+        return;
+    memcpy((uint8_t *)chip_loop_cache_block(chip_loop_block) + sizeof(oscillator), buffer, 2*len);
+    ++chip_loop_block;
+}
+#endif
+
 uint8_t chip_instrument_max_index(uint8_t i, uint8_t j)
 {   // Returns the max index we shouldn't run (instrument command-wise) based on the current index.
     if (chip_instrument[i].is_drum)
@@ -110,67 +325,163 @@ uint8_t chip_instrument_max_index(uint8_t i, uint8_t j)
     return MAX_INSTRUMENT_LENGTH;
 }
 
-int chip_instrument_invalid_jump
-(   uint8_t inst, uint8_t max_index, uint8_t jump_from_index, uint8_t j
-)
-{   // Check if this is an ok jump; if the jump command hits itself again before a wait,
-    // we'll get stuck in an infinite loop.
-    for (int k=0; k<20; ++k)
-    {   // Test going through the commands.
-        if (j >= max_index) // it's ok to jump out of the commands, this will be interpreted as stopping
+static int chip_instrument_runs_to_wait(uint8_t inst, uint8_t j, uint8_t max_index, int as_written)
+{   // Follows the instrument commands from j, returning 1 if we get to a wait (or stop), and
+    // 0 if we would loop forever.  Unless as_written, a jump that can be randomized also
+    // counts as a failure, since we can't know where it will go.
+    const uint8_t *cmd = chip_instrument[inst].cmd;
+    uint32_t visited = 0;
+    while (j < max_index)
+    {   if (visited & (1 << j)) // looped back without a wait
             return 0;
-        else if (j == jump_from_index) // returning to the same spot is out of the question
-            return 1;
-        switch (chip_instrument[inst].cmd[j]&15)
-        {   // Update instrument position j based on command:
-            case InstrumentJump:
-                j = chip_instrument[inst].cmd[j]>>4;
-                break;
-            case InstrumentWait:
-                // We found a wait, this jump is ok.
-                return 0;
+        visited |= 1 << j;
+        int randomized = j > 0 && (cmd[j-1]&15) == InstrumentRandomize;
+        switch (cmd[j]&15)
+        {   case InstrumentWait:
+                return 1;
             case InstrumentBreak:
-                if ((chip_instrument[inst].cmd[j]>>4) == 0)
+                if (!randomized && (cmd[j]>>4) == 0)
+                    return 1;
+                ++j;
+                break;
+            case InstrumentJump:
+                if (randomized && !as_written)
                     return 0;
+                j = cmd[j]>>4;
+                break;
             default:
                 ++j;
         }
     }
-    // do not proceed if no wait was found:
+    // it's ok to go past the commands, this will be interpreted as stopping
     return 1;
 }
 
-int chip_track_invalid_jump(uint8_t t, uint8_t i, uint8_t jump_from_index, uint8_t j)
-{   // Check if this is an ok jump; if the jump command hits itself again before a wait,
-    // we'll get stuck in an infinite loop.
-    for (int k=0; k<36; ++k)
-    {   // Test going through the commands.
-        if (j >= MAX_TRACK_LENGTH) // it's ok to jump out of the commands, this will be interpreted as stopping
-            return 0;
-        else if (j == jump_from_index) // returning to the same spot is out of the question
+int chip_instrument_analyze(uint8_t inst)
+{   // Updates chip_instrument_safe_jumps for this instrument; needs to be called
+    // whenever the instrument is modified (or loaded).  Returns 1 if the instrument
+    // can get stuck in a loop without a wait, 0 if everything is ok.
+    uint16_t safe = 0;
+    for (int j=0; j<MAX_INSTRUMENT_LENGTH; ++j)
+    if (chip_instrument_runs_to_wait(inst, j, MAX_INSTRUMENT_LENGTH, 0))
+        safe |= 1 << j;
+    chip_instrument_safe_jumps[inst] = safe;
+
+    // Check from every spot the instrument can start running commands from,
+    // i.e., the start of the note (or drum section) and after each wait:
+    const uint8_t *cmd = chip_instrument[inst].cmd;
+    for (int j=0; j<MAX_INSTRUMENT_LENGTH; ++j)
+    if
+    (   j == 0 || (cmd[j-1]&15) == InstrumentWait || (chip_instrument[inst].is_drum &&
+            (j == 2*DRUM_SECTION_LENGTH || j == 3*DRUM_SECTION_LENGTH))
+    )
+    {   if (!chip_instrument_runs_to_wait(inst, j, chip_instrument_max_index(inst, j), 1))
             return 1;
-        switch (chip_track[t][i][j]&15)
-        {   // Update track position j based on command:
-            case TrackJump:
-                j = 2*(chip_track[t][i][j]>>4);
-                break;
-            case TrackWait:
+    }
+    return 0;
+}
+
+static int chip_track_runs_to_wait(uint8_t t, uint8_t i, uint8_t j, int as_written)
+{   // Like chip_instrument_runs_to_wait, but for player i's part in track t.
+    const uint8_t *cmd = chip_track[t][i];
+    uint32_t visited = 0;
+    while (j < MAX_TRACK_LENGTH)
+    {   if (visited & (1u << j))
+            return 0;
+        visited |= 1u << j;
+        switch (cmd[j]&15)
+        {   case TrackWait:
             case TrackArpNote:
-                // We found a wait, this jump is ok.
-                return 0;
-            case TrackBreak:
-                if ((chip_track[t][i][j]>>4) == 0)
+            case TrackBreak: // either waits or stops the track, whatever the param
+                return 1;
+            case TrackJump:
+                if (!as_written && j > 0 && (cmd[j-1]&15) == TrackRandomize)
                     return 0;
+                j = 2*(cmd[j]>>4);
+                break;
             default:
                 ++j;
         }
     }
-    // do not proceed if no wait was found:
     return 1;
 }
 
+int chip_track_analyze(uint8_t t, uint8_t i)
+{   // Updates chip_track_safe_jumps for player i in track t, see chip_instrument_analyze.
+    uint16_t safe = 0;
+    for (int j=0; j<MAX_TRACK_LENGTH/2; ++j)
+    if (chip_track_runs_to_wait(t, i, 2*j, 0))
+        safe |= 1 << j;
+    chip_track_safe_jumps[t][i] = safe;
+
+    const uint8_t *cmd = chip_track[t][i];
+    for (int j=0; j<MAX_TRACK_LENGTH; ++j)
+    if (j == 0 || (cmd[j-1]&15) == TrackWait || (cmd[j-1]&15) == TrackArpNote || (cmd[j-1]&15) == TrackBreak)
+    {   if (!chip_track_runs_to_wait(t, i, j, 1))
+            return 1;
+    }
+    return 0;
+}
+
+static int chip_song_runs_to_wait(uint8_t j, int as_written)
+{   // Like chip_instrument_runs_to_wait, but for the song, where PlayTracksForCount is the wait.
+    // Unless as_written, conditionals also count as a failure.
+    uint32_t visited[MAX_SONG_LENGTH/32] = { 0 };
+    while (1)
+    {   if (visited[j/32] & (1u << (j%32)))
+            return 0;
+        visited[j/32] |= 1u << (j%32);
+        uint8_t command = chip_song_cmd[j];
+        int randomized = j > 0 &&
+        (   (chip_song_cmd[j-1]&15) == SongRandomize ||
+            chip_song_cmd[j-1] == (SongSpecial | (SongSetNextCommandParameterToA << 4))
+        );
+        switch (command & 15)
+        {   case SongPlayTracksForCount:
+                return 1;
+            case SongBreak:
+                // the song restarts, and waits first if the param is nonzero:
+                if (!randomized && (command>>4))
+                    return 1;
+                j = 0;
+                break;
+            case SongSpecial:
+                if ((command>>4) < 4 && !as_written)
+                    return 0;
+                ++j;
+                break;
+            case SongJump:
+                if (randomized && !as_written)
+                    return 0;
+                j = 16*(command>>4);
+                break;
+            default:
+                ++j; // wraps around at MAX_SONG_LENGTH
+        }
+    }
+}
+
+int chip_song_analyze()
+{   // Updates chip_song_safe_jumps, see chip_instrument_analyze.
+    uint16_t safe = 0;
+    for (int j=0; j<MAX_SONG_LENGTH/16; ++j)
+    if (chip_song_runs_to_wait(16*j, 0))
+        safe |= 1 << j;
+    chip_song_safe_jumps = safe;
+
+    for (int j=0; j<MAX_SONG_LENGTH; ++j)
+    if (j == 0 || (chip_song_cmd[j-1]&15) == SongPlayTracksForCount)
+    {   if (!chip_song_runs_to_wait(j, 1))
+            return 1;
+    }
+    return 0;
+}
+
 static uint8_t randomize(uint8_t arg)
 {   // Returns a random number between 0 and 15
+    #if CHIP_LOOP_CACHE_BYTES
+    chip_loop_spoiled = 1;
+    #endif
     switch (arg)
     {   // The argument specifies what kind of randomization is desired.
         // TODO: Name these arguments using an enum
@@ -210,6 +521,16 @@ static uint8_t randomize(uint8_t arg)
     return 0;
 }
 
+static inline uint8_t chip_player_instrument_command(uint8_t i, uint8_t inst, uint8_t j)
+{   // Returns instrument command j as player i sees it, i.e. with any randomized param.
+    uint8_t cmd = chip_instrument[inst].cmd[j];
+    if (chip_player[i].instrument_randomized & (1 << j))
+    {   uint8_t param = chip_player[i].instrument_randomized_param[j/2];
+        cmd = (cmd & 15) | (j % 2 ? param & 240 : param << 4);
+    }
+    return cmd;
+}
+
 static void chip_instrument_run_command(uint8_t i, uint8_t inst, uint8_t cmd) 
 {   // Have player i update their oscillator based on running a command on the instrument
     uint8_t param = cmd >> 4;
@@ -290,12 +611,18 @@ static void chip_instrument_run_command(uint8_t i, uint8_t inst, uint8_t cmd)
                 break;
             uint8_t random = randomize(param);
             uint8_t next_command_type = chip_instrument[inst].cmd[next_index] & 15;
-            if (next_command_type == InstrumentJump)
+            if (next_command_type == InstrumentJump && random < max_index &&
+                !(chip_instrument_safe_jumps[inst] & (1 << random)))
             {   // don't allow a randomized jump to cause an infinite loop:
-                if (chip_instrument_invalid_jump(inst, max_index, next_index, random))
-                    break; // do not continue, do not allow this number as a jump
+                break; // do not continue, do not allow this number as a jump
             }
-            chip_instrument[inst].cmd[next_index] = next_command_type | (random<<4);
+            // only this player sees the new param:
+            chip_player[i].instrument_randomized |= 1 << next_index;
+            uint8_t *params = &chip_player[i].instrument_randomized_param[next_index/2];
+            if (next_index % 2)
+                *params = (*params & 15) | (random << 4);
+            else
+                *params = (*params & 240) | random;
             break;
         }
         case InstrumentJump:
@@ -329,12 +656,23 @@ void chip_init()
 {   // initialize things (only happens once).
     chip_volume = 128;
     chip_reset_song();
+    for (int i=0; i<16; ++i)
+        chip_instrument_analyze(i);
+    for (int t=0; t<MAX_TRACKS; ++t)
+    for (int i=0; i<CHIP_PLAYERS; ++i)
+        chip_track_analyze(t, i);
+    chip_song_analyze();
     // we assume it's 256 so that wrap around works immediately with u8's:
     STATIC_ASSERT(MAX_SONG_LENGTH == 256);
+    #if CHIP_RENDER_AHEAD_SLOTS
+    // the render-ahead ring is indexed modulo 256:
+    STATIC_ASSERT((CHIP_RENDER_AHEAD_SLOTS & (CHIP_RENDER_AHEAD_SLOTS - 1)) == 0);
+    #endif
 }
 
 void chip_reset_player(int i)
 {   // resets player i to a clean slate
+    chip_render_ahead_flush();
     chip_instrument_for_next_note_for_player[i] = i;
     chip_player[i].instrument = i;
     chip_player[i].cmd_index = 0;
@@ -355,12 +693,17 @@ void chip_reset_player(int i)
     chip_player[i].track_vibrato_rate = 0;
     chip_player[i].track_vibrato_depth = 0;
     chip_player[i].bendd = 0;
+    chip_player[i].instrument_randomized = 0;
     chip_player[i].octave = chip_instrument[i].octave;
 }
 
 void chip_kill()
 {   // Stops playing all sounds
+    chip_render_ahead_flush();
     chip_playing = PlayingNone;
+    #if CHIP_LOOP_CACHE_BYTES
+    chip_loop_state = LoopCacheIdle;
+    #endif
     for (int i=0; i<CHIP_PLAYERS; ++i)
     {   // Turn off all oscillators for good measure
         oscillator[i].volume = 0;
@@ -369,11 +712,26 @@ void chip_kill()
     }
 }
 
+void chip_hot_patch()
+{   // Call after changing instruments, tracks or the song while something may be playing.
+    // Players keep going from where they are (commands already run stay run), and
+    // the changed commands get picked up from the next tick on.
+    // The programs need to be checked first (see chip_instrument_analyze and friends),
+    // a loop without a wait would hang the players, so call chip_kill() instead for those.
+    chip_render_ahead_flush();
+    #if CHIP_LOOP_CACHE_BYTES
+    // recorded loops were rendered from the old commands:
+    chip_loop_cache_clear();
+    #endif
+}
+
 void chip_play_song(int pos) 
 {   // Start playing a song from the provided position.
+    chip_render_ahead_flush();
     chip_reset_song();
     chip_playing = PlayingSong;
     chip_song_cmd_index = pos;
+    chip_song_loops = 0;
     
     for (int i=0; i<CHIP_PLAYERS; ++i)
         chip_reset_player(i);
@@ -384,6 +742,7 @@ void chip_play_track(int track, int which_players)
     // If track >= MAX_TRACKS, no track will be played.
     // If which_players == 0, everyone plays, otherwise use a bit mask
     // for which players should play (via 1 << player_index).
+    chip_render_ahead_flush();
     chip_reset_song();
     chip_playing = PlayingTrack;
     if (which_players == 0)
@@ -451,12 +810,14 @@ static void chip_play_note_internal(uint8_t p, uint8_t note)
     chip_player[p].vibrato_rate = 1;
     chip_player[p].bend = 0;
     chip_player[p].bendd = 0;
+    chip_player[p].instrument_randomized = 0;
     oscillator[p].pan = 8; // default to output both L/R
     oscillator[p].duty = 0x8000; // default to square wave
 }
 
 void chip_play_note(uint8_t p, uint8_t inst, uint8_t note, uint8_t volume)
 {   // for player `p`, using instrument `inst`, plays a note with some volume
+    chip_render_ahead_flush();
     uint8_t old_instrument = chip_instrument_for_next_note_for_player[p];
     chip_instrument_for_next_note_for_player[p] = inst;
     chip_play_note_internal(p, note + 12 * chip_player[p].octave);
@@ -799,7 +1160,7 @@ static void track_run_command(uint8_t i, uint8_t cmd)
             uint8_t random = randomize(param);
             uint8_t t = chip_player[i].track_index;
             if ((chip_track[t][i][next_index]&15) == TrackJump && 
-                chip_track_invalid_jump(t, i, next_index, 2*random))
+                !(chip_track_safe_jumps[t][i] & (1 << random)))
                 break;
             chip_track[t][i][next_index] = 
                 (chip_track[t][i][next_index]&15) | (random<<4);
@@ -836,6 +1197,10 @@ static inline void chip_update_players_for_track()
     #ifdef DEBUG_CHIPTUNE
     message("%02d", track_pos);
     #endif
+    #if CHIP_LOOP_CACHE_BYTES
+    if (!track_pos)
+        chip_loop_cache_enter();
+    #endif
 
     for (int p=0; p<CHIP_PLAYERS; ++p) 
     {   uint8_t track_index = chip_player[p].track_index;
@@ -866,34 +1231,6 @@ static inline void chip_update_players_for_track()
     }
 }
 
-static int chip_song_invalid_jump(uint8_t jump_from_index, uint8_t j)
-{   // returns true if jump (from jump_from_index) to the index j is invalid.
-    for (int k=0; k<20; ++k)
-    {   if (j == jump_from_index) // returning to the same spot is out of the question
-            return 1;
-        uint8_t command = chip_song_cmd[j];
-        switch (command & 15)
-        {   // Update instrument position j based on command:
-            // TODO: SongBreak (0 isn't ok, 1-15 is ok, but check for randomization before)
-            case SongPlayTracksForCount:
-                // We found a wait, this jump is ok.
-                return 0;
-            case SongSpecial:
-                // if we have special conditionals, also die.
-                // make sure to play tracks for count before these.
-                if ((command>>4) < 4)
-                    return 1;
-            case SongJump:
-                j = (command >> 4) * 16;
-                break;
-            default:
-                ++j;
-        }
-    }
-    // invalid jump
-    return 1;
-}
-
 static void chip_song_try_setting_current_command_param_to(uint8_t param)
 {   // checks for jumps and conditionals before assigning new param.
     uint8_t current_command = chip_song_cmd[chip_song_cmd_index];
@@ -907,7 +1244,7 @@ static void chip_song_try_setting_current_command_param_to(uint8_t param)
             break;
         case SongJump:
             // require jumps to be valid:
-            if (chip_song_invalid_jump(chip_song_cmd_index, param))
+            if (!(chip_song_safe_jumps & (1 << param)))
                 return;
             break;
     }
@@ -922,6 +1259,7 @@ static inline void chip_song_run_command(uint8_t cmd)
     {   case SongBreak:
             chip_reset_song();
             chip_playing = PlayingSong;
+            ++chip_song_loops;
             // TODO: adjust multiplier on param if needed:
             chip_track_playtime = 2 * param;
             break;
@@ -1091,6 +1429,7 @@ static void chip_update_oscillators()
         if (!chip_player[i].track_volume && chip_player[i].track_volumed <= 0)
         {   // Short-circuit quiet tracks
             oscillator[i].volume = 0;
+            oscillator[i].phase = 0;
             continue;
         }
         int16_t vol;
@@ -1104,7 +1443,7 @@ static void chip_update_oscillators()
         // We can get a command to set wait to nonzero, so make sure we escape in that case:
         while (!chip_player[i].wait && chip_player[i].cmd_index < max_index)
         {   chip_instrument_run_command
-            (   i, inst, chip_instrument[inst].cmd[chip_player[i].cmd_index++]
+            (   i, inst, chip_player_instrument_command(i, inst, chip_player[i].cmd_index++)
             );
         }
 
@@ -1247,6 +1586,10 @@ static void chip_update_oscillators()
         }
 
         oscillator[i].volume = (chip_player[i].volume * chip_player[i].track_volume * chip_volume) >> 16;
+        // The phase of a silent oscillator can't be heard, so restart it from a known spot;
+        // this keeps the state of repeating loops identical (see chip_loop_cache_enter).
+        if (!oscillator[i].volume)
+            oscillator[i].phase = 0;
 
         oscillator[i].duty += chip_player[i].dutyd << 6;
         if (!oscillator[i].duty || oscillator[i].duty == 65535)
@@ -1258,24 +1601,9 @@ static inline uint16_t gen_sample()
 {   // This function generates one audio sample for all CHIP_PLAYERS oscillators. The returned
     // value is a 2*8bit stereo audio sample ready for putting in the audio buffer.
 
-    // This is a simple noise generator based on an LFSR (linear feedback shift
-    // register). It is fast and simple and works reasonably well for audio.
-    // Note that we always run this so the noise is not dependent on the
+    // Note that we always run the noise so it is not dependent on the
     // oscillators frequencies.
-    static uint32_t noiseseed = 1;
-    static uint32_t rednoise = 0;
-    static uint32_t violetnoise = 0;
-    uint32_t newbit;
-    newbit = 0;
-    if (noiseseed & 0x80000000L) newbit ^= 1;
-    if (noiseseed & 0x01000000L) newbit ^= 1;
-    if (noiseseed & 0x00000040L) newbit ^= 1;
-    if (noiseseed & 0x00000200L) newbit ^= 1;
-    noiseseed = (noiseseed << 1) | newbit;
-    rednoise = 3*rednoise/4 + (noiseseed&255)/4;
-    // violet should be the derivative of white noise, but that wasn't nice:
-    // this gives some higher freqs, and a metallic ring too:
-    violetnoise = violetnoise/6 + ((noiseseed&255)-128); 
+    gen_noise();
 
     int16_t acc[2] = { 0, 0 }; // accumulators for each channel
     
@@ -1472,17 +1800,376 @@ static inline uint16_t gen_sample()
     return (128 + (acc[0] >> 8))|(((128 + (acc[1] >> 8))) << 8);  // 2*[1,251]
 }
 
-void game_snd_buffer(uint16_t* buffer, int len) 
-{   // Called by Bitbox to create the sound buffer; DO NOT CALL yourself.
+static int chip_render_begin(uint16_t *buffer, int len)
+{   // Advances the players by one sound buffer, returns 1 if the buffer got filled already.
     if (chip_playing)
         chip_update_players();
 
     // Even if a song/track is not playing, update oscillators in case a "chip_play_note" gets called.
     chip_update_oscillators();
 
-    // Generate enough samples to fill the buffer.
-    for (int i=0; i<len; i++)
-        buffer[i] = gen_sample();
+    #if CHIP_LOOP_CACHE_BYTES
+    if (chip_loop_cache_replay(buffer, len))
+        return 1;
+    chip_loop_cache_record_oscillators(len);
+    #endif
+    return 0;
+}
+
+static void chip_render_end(const uint16_t *buffer, int len)
+{   // Called once all samples of the buffer started with chip_render_begin are generated.
+    #if CHIP_LOOP_CACHE_BYTES
+    chip_loop_cache_record_samples(buffer, len);
+    #endif
+}
+
+#if CHIP_RENDER_AHEAD_SLOTS
+// Sound buffers rendered ahead of time, in a ring starting at chip_ahead_head.
+// Each slot keeps a snapshot of the chip state from right before it was rendered,
+// so that we can go back to the state matching what has actually been played.
+struct chip_snapshot
+{   struct chip_player player[CHIP_PLAYERS];
+    struct oscillator oscillator[CHIP_PLAYERS];
+    uint8_t instrument_for_next_note_for_player[CHIP_PLAYERS];
+    uint32_t noiseseed, rednoise, violetnoise;
+    chip_playing_t playing;
+    uint8_t volume;
+    uint8_t track_playtime;
+    uint8_t track_pos;
+    uint8_t song_cmd_index;
+    uint8_t song_players;
+    uint8_t song_volume;
+    int8_t song_volumed;
+    uint8_t song_transpose;
+    uint8_t song_wait;
+    uint8_t song_speed;
+    uint8_t song_variable_A;
+    uint8_t song_variable_B;
+    uint8_t song_squarify;
+    uint8_t song_loops;
+};
+
+struct chip_ahead_slot
+{   uint16_t buffer[CHIP_RENDER_AHEAD_LEN];
+    struct chip_snapshot before;
+    // number of samples generated so far, CHIP_RENDER_AHEAD_LEN when ready:
+    uint16_t done;
+    // chip_song_loops once the players were updated for this buffer:
+    uint8_t song_loops;
+    // oscillator volumes for this buffer, for the tap:
+    uint8_t volume[CHIP_PLAYERS];
+};
+
+uint8_t chip_render_ahead_limit = CHIP_RENDER_AHEAD_SLOTS/2;
+uint32_t chip_render_ahead_underruns;
+
+static struct chip_ahead_slot chip_ahead_slot[CHIP_RENDER_AHEAD_SLOTS];
+// Slots published and slots handed out so far (modulo 256), the difference is the number
+// of fully rendered slots waiting in the queue.  The slot at chip_ahead_written is being
+// filled while chip_ahead_rendering is set, and only gets published once it's complete.
+// Who may touch what:
+//   - only the reader (the sound callback, or chip_render_ahead_take) increments chip_ahead_read.
+//   - chip_ahead_written, chip_ahead_rendering and the chip state belong to the renderer
+//     (chip_render_ahead_work, and chip_render_ahead_flush in the same context), except while
+//     the sound callback holds chip_ahead_popping and the renderer isn't chip_ahead_busy: then
+//     the callback may finish the partial slot or render a buffer itself.
+//   - while chip_ahead_dropping, chip_render_ahead_flush rolls the queue back, and the callback
+//     leaves the queue and the chip state alone.
+static volatile uint8_t chip_ahead_written;
+static volatile uint8_t chip_ahead_read;
+static volatile uint8_t chip_ahead_rendering;
+static volatile uint8_t chip_ahead_busy;
+static volatile uint8_t chip_ahead_popping;
+static volatile uint8_t chip_ahead_dropping;
+#define CHIP_AHEAD_COUNT ((uint8_t)(chip_ahead_written - chip_ahead_read))
+#define CHIP_AHEAD_SLOT(k) (&chip_ahead_slot[(uint8_t)(k) % CHIP_RENDER_AHEAD_SLOTS])
+// orders the slot contents against the counters, the reader can be on another thread in the emulator:
+#define CHIP_AHEAD_FENCE() __sync_synchronize()
+// game code is changing the chip state, don't render ahead until the frame is done:
+static volatile uint8_t chip_ahead_paused = 1;
+
+static void chip_snapshot_save(struct chip_snapshot *s)
+{   memcpy(s->player, chip_player, sizeof(chip_player));
+    memcpy(s->oscillator, oscillator, sizeof(oscillator));
+    memcpy(s->instrument_for_next_note_for_player, chip_instrument_for_next_note_for_player, CHIP_PLAYERS);
+    s->noiseseed = noiseseed;
+    s->rednoise = rednoise;
+    s->violetnoise = violetnoise;
+    s->playing = chip_playing;
+    s->volume = chip_volume;
+    s->track_playtime = chip_track_playtime;
+    s->track_pos = track_pos;
+    s->song_cmd_index = chip_song_cmd_index;
+    s->song_players = chip_song_players;
+    s->song_volume = chip_song_volume;
+    s->song_volumed = chip_song_volumed;
+    s->song_transpose = song_transpose;
+    s->song_wait = song_wait;
+    s->song_speed = song_speed;
+    s->song_variable_A = chip_song_variable_A;
+    s->song_variable_B = chip_song_variable_B;
+    s->song_squarify = chip_song_squarify;
+    s->song_loops = chip_song_loops;
+}
+
+static void chip_snapshot_restore(const struct chip_snapshot *s)
+{   memcpy(chip_player, s->player, sizeof(chip_player));
+    memcpy(oscillator, s->oscillator, sizeof(oscillator));
+    memcpy(chip_instrument_for_next_note_for_player, s->instrument_for_next_note_for_player, CHIP_PLAYERS);
+    noiseseed = s->noiseseed;
+    rednoise = s->rednoise;
+    violetnoise = s->violetnoise;
+    chip_playing = s->playing;
+    chip_volume = s->volume;
+    chip_track_playtime = s->track_playtime;
+    track_pos = s->track_pos;
+    chip_song_cmd_index = s->song_cmd_index;
+    chip_song_players = s->song_players;
+    chip_song_volume = s->song_volume;
+    chip_song_volumed = s->song_volumed;
+    song_transpose = s->song_transpose;
+    song_wait = s->song_wait;
+    song_speed = s->song_speed;
+    chip_song_variable_A = s->song_variable_A;
+    chip_song_variable_B = s->song_variable_B;
+    chip_song_squarify = s->song_squarify;
+    chip_song_loops = s->song_loops;
+    #if CHIP_LOOP_CACHE_BYTES
+    // whatever was being recorded or replayed no longer lines up:
+    chip_loop_state = LoopCacheIdle;
+    #endif
+}
+
+static void chip_ahead_drop()
+{   // Throws away any sound rendered ahead of time, putting the chip back in the state right
+    // after the last buffer that was handed to Bitbox.  Renderer side only.
+    chip_ahead_dropping = 1;
+    CHIP_AHEAD_FENCE();
+    while (chip_ahead_popping)
+    {   // the sound callback is taking a buffer right now (only possible in the emulator),
+        // wait so that chip_ahead_read stays put from here on.
+    }
+    if (CHIP_AHEAD_COUNT)
+        chip_snapshot_restore(&CHIP_AHEAD_SLOT(chip_ahead_read)->before);
+    else if (chip_ahead_rendering)
+        chip_snapshot_restore(&CHIP_AHEAD_SLOT(chip_ahead_written)->before);
+    chip_ahead_rendering = 0;
+    chip_ahead_written = chip_ahead_read;
+    CHIP_AHEAD_FENCE();
+    chip_ahead_dropping = 0;
+}
+
+void chip_render_ahead_flush()
+{   // Drops the sound rendered ahead of time and pauses rendering ahead until
+    // chip_render_ahead_resume(); call this before changing anything in the chip state.
+    chip_ahead_paused = 1;
+    chip_ahead_drop();
+}
+
+void chip_render_ahead_resume()
+{   // Allows rendering ahead again, call once all changes to the chip state are done (e.g. at the end of the frame).
+    chip_ahead_paused = 0;
+}
+
+static void chip_ahead_publish()
+{   // Hands the (complete) slot at chip_ahead_written over to the reader.
+    CHIP_AHEAD_FENCE();
+    chip_ahead_rendering = 0;
+    ++chip_ahead_written;
+}
+
+static void chip_ahead_fill(struct chip_ahead_slot *slot, int samples)
+{   // Generates up to `samples` more samples for the partial slot, publishing it once complete.
+    while (samples-- > 0 && slot->done < CHIP_RENDER_AHEAD_LEN)
+        slot->buffer[slot->done++] = gen_sample();
+    if (slot->done == CHIP_RENDER_AHEAD_LEN)
+    {   chip_render_end(slot->buffer, CHIP_RENDER_AHEAD_LEN);
+        chip_ahead_publish();
+    }
+}
+
+static int chip_ahead_step(int samples)
+{   // One chunk of chip_render_ahead_work, with the chip state to ourselves.
+    struct chip_ahead_slot *slot = CHIP_AHEAD_SLOT(chip_ahead_written);
+    if (chip_ahead_rendering)
+    {   chip_ahead_fill(slot, samples);
+        return 1;
+    }
+    uint8_t count = CHIP_AHEAD_COUNT;
+    if (count >= chip_render_ahead_limit || count >= CHIP_RENDER_AHEAD_SLOTS)
+        return 0;
+    chip_snapshot_save(&slot->before);
+    slot->done = 0;
+    chip_ahead_rendering = 1;
+    int filled = chip_render_begin(slot->buffer, CHIP_RENDER_AHEAD_LEN);
+    slot->song_loops = chip_song_loops;
+    for (int i=0; i<CHIP_PLAYERS; ++i)
+        slot->volume[i] = oscillator[i].volume;
+    if (filled)
+    {   slot->done = CHIP_RENDER_AHEAD_LEN;
+        chip_ahead_publish();
+    }
+    return 1;
+}
+
+int chip_render_ahead_work(int samples)
+{   // Renders a bit of future sound, call this when there's some time to spare.
+    // Starting a new buffer (which runs the player commands) counts as one chunk of work,
+    // otherwise up to `samples` samples get generated.  Returns 0 if there was nothing to do.
+    if (chip_ahead_paused)
+        return 0;
+    chip_ahead_busy = 1;
+    CHIP_AHEAD_FENCE();
+    if (chip_ahead_popping)
+    {   // the sound callback might be using the chip state, try again later:
+        chip_ahead_busy = 0;
+        return 0;
+    }
+    int result = chip_ahead_step(samples);
+    CHIP_AHEAD_FENCE();
+    chip_ahead_busy = 0;
+    return result;
+}
+
+static int chip_render_ahead_pop(uint16_t *buffer, int len, const uint8_t **volume)
+{   // Fills the buffer from the render-ahead queue, finishing a partial buffer first if the
+    // renderer is out of the way.  Call with chip_ahead_popping set.  Returns 0 if nothing
+    // was ready, and chip_ahead_exclusive() says whether the caller may render instead.
+    if (chip_ahead_dropping)
+        return 0;
+    if (len != CHIP_RENDER_AHEAD_LEN)
+    {   // Bitbox wants another buffer size, so stop rendering ahead and skip what's queued:
+        chip_render_ahead_limit = 0;
+        chip_ahead_read = chip_ahead_written;
+        return 0;
+    }
+    if (!CHIP_AHEAD_COUNT)
+    {   if (chip_render_ahead_limit)
+            ++chip_render_ahead_underruns;
+        if (!chip_ahead_rendering || chip_ahead_busy)
+            return 0;
+        // the renderer got partway through the next buffer, finish it here:
+        chip_ahead_fill(CHIP_AHEAD_SLOT(chip_ahead_written), CHIP_RENDER_AHEAD_LEN);
+    }
+    CHIP_AHEAD_FENCE();
+    struct chip_ahead_slot *slot = CHIP_AHEAD_SLOT(chip_ahead_read);
+    memcpy(buffer, slot->buffer, 2*len);
+    *volume = slot->volume;
+    CHIP_AHEAD_FENCE();
+    ++chip_ahead_read;
+    return 1;
+}
+
+static int chip_ahead_exclusive()
+{   // Returns 1 if the sound callback (holding chip_ahead_popping) may use the chip state,
+    // i.e. the renderer is neither running nor partway through a buffer.
+    return !chip_ahead_dropping && !chip_ahead_busy && !chip_ahead_rendering;
+}
+
+int chip_render_ahead_take(uint16_t *buffer, uint8_t *song_loops)
+{   // Takes the next sound buffer (CHIP_RENDER_AHEAD_LEN samples) if it's fully rendered,
+    // for use with chip_sound_off.  Unlike the sound callback, this never renders anything
+    // itself, so it can be called from the main loop while chip_render_ahead_work runs in
+    // interrupts.  Returns 1 if the buffer was filled, and sets *song_loops to chip_song_loops
+    // as of that buffer.
+    if (!CHIP_AHEAD_COUNT)
+        return 0;
+    CHIP_AHEAD_FENCE();
+    struct chip_ahead_slot *slot = CHIP_AHEAD_SLOT(chip_ahead_read);
+    memcpy(buffer, slot->buffer, 2*CHIP_RENDER_AHEAD_LEN);
+    *song_loops = slot->song_loops;
+    CHIP_AHEAD_FENCE();
+    ++chip_ahead_read;
+    return 1;
+}
+#else
+void chip_render_ahead_flush() {}
+void chip_render_ahead_resume() {}
+int chip_render_ahead_work(int samples) { return 0; }
+
+int chip_render_ahead_take(uint16_t *buffer, uint8_t *song_loops)
+{   // Nothing gets rendered ahead, so render the buffer right away.
+    if (!chip_render_begin(buffer, CHIP_RENDER_AHEAD_LEN))
+    {   for (int i=0; i<CHIP_RENDER_AHEAD_LEN; i++)
+            buffer[i] = gen_sample();
+        chip_render_end(buffer, CHIP_RENDER_AHEAD_LEN);
+    }
+    *song_loops = chip_song_loops;
+    return 1;
+}
+#endif
+
+static void chip_tap_samples(const uint16_t *buffer, int len, const uint8_t *volume)
+{   // Copies the end of the buffer into the tap, then lets readers know.
+    if (len > CHIP_TAP_LEN)
+    {   buffer += len - CHIP_TAP_LEN;
+        len = CHIP_TAP_LEN;
+    }
+    uint32_t written = chip_tap_written;
+    for (int i=0; i<len; ++i)
+        chip_tap[(written + i) % CHIP_TAP_LEN] = buffer[i];
+    memcpy(chip_tap_volume, volume, CHIP_PLAYERS);
+    chip_tap_written = written + len;
+}
+
+static void chip_silence(uint16_t *buffer, int len)
+{   for (int i=0; i<len; i++)
+        buffer[i] = 128 | (128 << 8);
+}
+
+static void chip_render_now(uint16_t *buffer, int len)
+{   // Renders the buffer straight from the chip state.
+    uint8_t current_volume[CHIP_PLAYERS];
+    if (!chip_render_begin(buffer, len))
+    {   // Generate enough samples to fill the buffer.
+        for (int i=0; i<len; i++)
+            buffer[i] = gen_sample();
+
+        chip_render_end(buffer, len);
+    }
+
+    if (chip_tap_enabled)
+    {   for (int i=0; i<CHIP_PLAYERS; ++i)
+            current_volume[i] = oscillator[i].volume;
+        chip_tap_samples(buffer, len, current_volume);
+    }
+}
+
+static void chip_snd_buffer(uint16_t* buffer, int len)
+{   // Fills the sound buffer for game_snd_buffer.
+    if (chip_sound_off)
+    {   // someone else is taking the sound (see chip_render_ahead_take), play silence:
+        chip_silence(buffer, len);
+        return;
+    }
+
+    #if CHIP_RENDER_AHEAD_SLOTS
+    // keeps the renderer out of the chip state, and flushes from moving the queue:
+    chip_ahead_popping = 1;
+    CHIP_AHEAD_FENCE();
+    const uint8_t *volume;
+    if (chip_render_ahead_pop(buffer, len, &volume))
+    {   if (chip_tap_enabled)
+            chip_tap_samples(buffer, len, volume);
+    }
+    else if (chip_ahead_exclusive())
+        chip_render_now(buffer, len);
+    else
+    {   // the renderer is using the chip state right now, so this buffer is silent:
+        chip_silence(buffer, len);
+    }
+    CHIP_AHEAD_FENCE();
+    chip_ahead_popping = 0;
+    #else
+    chip_render_now(buffer, len);
+    #endif
+}
+
+void game_snd_buffer(uint16_t* buffer, int len) 
+{   // Called by Bitbox to create the sound buffer; DO NOT CALL yourself.
+    uint32_t start = cycles_now();
+    chip_snd_buffer(buffer, len);
+    profile_sound(start);
 }
 
 #ifdef EMULATOR
@@ -1551,6 +2238,108 @@ void test_chip()
         ASSERT(chip_try_finding_root_in_scale(scale, 5, 12 + 5) == 5);
         ASSERT(chip_try_finding_root_in_scale(scale, 12 + 9, 5*12 + 9) == 12 + 9);
     }
+    {   // loops without a wait are rejected, loops with a wait are fine
+        chip_instrument_t saved_instrument = chip_instrument[0];
+        uint8_t saved_track[MAX_TRACK_LENGTH];
+        uint8_t saved_song[MAX_SONG_LENGTH];
+        memcpy(saved_track, chip_track[0][0], sizeof(saved_track));
+        memcpy(saved_song, chip_song_cmd, sizeof(saved_song));
+
+        memset(&chip_instrument[0], 0, sizeof(chip_instrument_t));
+        chip_instrument[0].cmd[0] = InstrumentNote | (0<<4);
+        chip_instrument[0].cmd[1] = InstrumentJump | (0<<4);
+        ASSERT(chip_instrument_analyze(0) == 1);
+        ASSERT(!(chip_instrument_safe_jumps[0] & 1));
+        chip_instrument[0].cmd[1] = InstrumentWait | (1<<4);
+        chip_instrument[0].cmd[2] = InstrumentJump | (0<<4);
+        ASSERT(chip_instrument_analyze(0) == 0);
+        ASSERT(chip_instrument_safe_jumps[0] & 1);
+
+        memset(chip_track[0][0], 0, sizeof(saved_track));
+        chip_track[0][0][0] = TrackNote | (0<<4);
+        chip_track[0][0][1] = TrackJump | (0<<4);
+        ASSERT(chip_track_analyze(0, 0) == 1);
+        ASSERT(!(chip_track_safe_jumps[0][0] & 1));
+        chip_track[0][0][1] = TrackWait | (1<<4);
+        chip_track[0][0][2] = TrackJump | (0<<4);
+        ASSERT(chip_track_analyze(0, 0) == 0);
+        ASSERT(chip_track_safe_jumps[0][0] & 1);
+
+        memset(chip_song_cmd, 0, sizeof(saved_song));
+        chip_song_cmd[0] = SongVolume | (15<<4);
+        chip_song_cmd[1] = SongJump | (0<<4);
+        ASSERT(chip_song_analyze() == 1);
+        ASSERT(!(chip_song_safe_jumps & 1));
+        chip_song_cmd[1] = SongPlayTracksForCount | (1<<4);
+        chip_song_cmd[2] = SongJump | (0<<4);
+        ASSERT(chip_song_analyze() == 0);
+        ASSERT(chip_song_safe_jumps & 1);
+
+        chip_instrument[0] = saved_instrument;
+        memcpy(chip_track[0][0], saved_track, sizeof(saved_track));
+        memcpy(chip_song_cmd, saved_song, sizeof(saved_song));
+        chip_instrument_analyze(0);
+        chip_track_analyze(0, 0);
+        chip_song_analyze();
+    }
+    #if CHIP_LOOP_CACHE_BYTES
+    {   // a track loop replays from the cache exactly as it would have been synthesized
+        chip_instrument_t saved_instrument = chip_instrument[0];
+        uint8_t saved_track[CHIP_PLAYERS][MAX_TRACK_LENGTH];
+        memcpy(saved_track, chip_track[0], sizeof(saved_track));
+        memset(&chip_instrument[0], 0, sizeof(chip_instrument_t));
+        memset(chip_track[0], 0, sizeof(saved_track));
+        chip_instrument[0].octave = 3;
+        chip_instrument[0].cmd[0] = InstrumentVolume | (15<<4);
+        chip_instrument[0].cmd[1] = InstrumentWaveform | (WfSaw<<4);
+        chip_instrument[0].cmd[2] = InstrumentNote | (0<<4);
+        chip_instrument[0].cmd[3] = InstrumentWait | (4<<4);
+        // going silent lets the oscillator phase restart, so every loop starts from the same state:
+        chip_instrument[0].cmd[4] = InstrumentVolume | (0<<4);
+        chip_track[0][0][0] = TrackNote | (0<<4);
+        chip_track[0][0][1] = TrackWait | (8<<4);
+        chip_track[0][0][2] = TrackNote | (7<<4);
+        chip_track[0][0][3] = TrackWait | (8<<4);
+
+        // 64 ticks of 4 buffers each, so the vibrato phase also comes back around every loop:
+        #define TEST_LOOP_BUFFERS (4*64)
+        #define TEST_LOOP_LEN 64
+        static uint16_t synthesized[4*TEST_LOOP_BUFFERS][TEST_LOOP_LEN];
+        uint16_t buffer[TEST_LOOP_LEN];
+        uint32_t saved_budget = chip_loop_cache_budget;
+        uint8_t saved_volume = chip_volume;
+        chip_volume = 128;
+        for (int cached = 0; cached < 2; ++cached)
+        {   chip_loop_cache_budget = cached ? CHIP_LOOP_CACHE_BYTES : 0;
+            chip_loop_cache_clear();
+            uint32_t hits = chip_loop_cache_hits;
+            chip_track_playtime = 64;
+            chip_play_track(0, 1);
+            song_speed = 3;
+            for (int b = 0; b < 4*TEST_LOOP_BUFFERS; ++b)
+            if (cached)
+            {   chip_render_now(buffer, TEST_LOOP_LEN);
+                ASSERT(memcmp(buffer, synthesized[b], sizeof(buffer)) == 0);
+            }
+            else
+                chip_render_now(synthesized[b], TEST_LOOP_LEN);
+            // make sure there was something to hear:
+            ASSERT(synthesized[4][0] != synthesized[0][0]);
+            // the first two loops get recorded (the first starts from a reset player),
+            // the third comes from the cache:
+            ASSERT(chip_loop_cache_hits - hits == (cached ? 1 : 0));
+        }
+        #undef TEST_LOOP_BUFFERS
+        #undef TEST_LOOP_LEN
+        chip_kill();
+        chip_volume = saved_volume;
+        chip_loop_cache_budget = saved_budget;
+        chip_loop_cache_clear();
+        chip_track_playtime = 0;
+        chip_instrument[0] = saved_instrument;
+        memcpy(chip_track[0], saved_track, sizeof(saved_track));
+    }
+    #endif
     // TODO: other random scale
     message("chip tests passed!\n");
 }
@@ -262,7 +262,7 @@ typedef struct chip_instrument
 {   uint8_t is_drum;
     uint8_t octave;
     // commands which create the instrument sound
-    // stuff in the cmd array can be modified externally.
+    // stuff in the cmd array can be modified externally, but not by playback.
     uint8_t cmd[MAX_INSTRUMENT_LENGTH];
 } chip_instrument_t;
 
@@ -321,6 +321,12 @@ struct chip_player
     uint8_t track_cmd_index;
     uint8_t track_index; // current track index, 0 - 31
     uint8_t next_track_index; // used for looping a track or playing next track in the song
+
+    // InstrumentRandomize doesn't modify the (shared) instrument, but writes here instead.
+    // If bit j of instrument_randomized is set, the param of command j is taken from
+    // nibble j of instrument_randomized_param.  Cleared whenever a new note starts.
+    uint16_t instrument_randomized;
+    uint8_t instrument_randomized_param[MAX_INSTRUMENT_LENGTH/2];
 };
 
 void chip_reset_player(int i);
@@ -342,6 +348,7 @@ extern uint8_t chip_song_variable_B;
 void chip_init();
 void chip_reset();
 void chip_kill();
+void chip_hot_patch();
 void chip_play_song(int pos);
 void chip_play_track(int track, int which_players);
 // TODO: chip_snapshot() and chip_restore() if people want to make a broken record sound
@@ -350,9 +357,73 @@ void chip_play_track(int track, int which_players);
 void chip_play_note(uint8_t p, uint8_t inst, uint8_t note, uint8_t track_volume);
 
 uint8_t chip_instrument_max_index(uint8_t i, uint8_t j);
-int chip_instrument_invalid_jump
-(   uint8_t inst, uint8_t max_index, uint8_t jump_from_index, uint8_t j
-);
-int chip_track_invalid_jump(uint8_t t, uint8_t i, uint8_t jump_from_index, uint8_t j);
+
+// Bit j is set if a randomized jump to command j (2*j for tracks, 16*j for the song) is sure
+// to get to a wait (or the end) without going through another randomized jump.
+// Call the corresponding *_analyze function after modifying (or loading) a program;
+// it returns 1 if the program as written can loop forever without waiting.
+extern uint16_t chip_instrument_safe_jumps[16];
+extern uint16_t chip_track_safe_jumps[MAX_TRACKS][CHIP_PLAYERS];
+extern uint16_t chip_song_safe_jumps;
+int chip_instrument_analyze(uint8_t inst);
+int chip_track_analyze(uint8_t t, uint8_t i);
+int chip_song_analyze();
+
+// Optional cache of the samples generated for a whole track loop.  When a loop starts from the
+// same player/oscillator state as one that was recorded before, its sound buffers are copied
+// instead of synthesized again.  Define CHIP_LOOP_CACHE_BYTES to 0 to compile it out.
+#ifndef CHIP_LOOP_CACHE_BYTES
+#ifdef EMULATOR
+#define CHIP_LOOP_CACHE_BYTES (1024*1024)
+#else
+#define CHIP_LOOP_CACHE_BYTES 0
+#endif
+#endif
+
+#if CHIP_LOOP_CACHE_BYTES
+// can be lowered at runtime (values above CHIP_LOOP_CACHE_BYTES are ignored), 0 turns it off:
+extern uint32_t chip_loop_cache_budget;
+// number of loops replayed entirely from the cache, and loops that had to be synthesized:
+extern uint32_t chip_loop_cache_hits;
+extern uint32_t chip_loop_cache_misses;
+void chip_loop_cache_clear();
+#endif
+
+// Sound buffers can be rendered ahead of time when the CPU is otherwise idle (see
+// chip_render_ahead_work), so game_snd_buffer only needs to copy them.  The chip functions
+// above flush this queue themselves; game code which changes the chip state directly needs
+// to call chip_render_ahead_flush() first.  Define CHIP_RENDER_AHEAD_SLOTS to 0 to compile it out.
+#ifndef CHIP_RENDER_AHEAD_SLOTS
+#define CHIP_RENDER_AHEAD_SLOTS 4 // needs to be a power of 2
+#endif
+#define CHIP_RENDER_AHEAD_LEN BITBOX_SNDBUF_LEN
+// samples to generate per call of chip_render_ahead_work from graph_line, small enough to fit in a line:
+#define CHIP_RENDER_AHEAD_CHUNK 8
+
+#if CHIP_RENDER_AHEAD_SLOTS
+// max number of buffers to render ahead (i.e., the added latency), up to CHIP_RENDER_AHEAD_SLOTS:
+extern uint8_t chip_render_ahead_limit;
+// number of sound buffers which weren't (fully) rendered ahead of time:
+extern uint32_t chip_render_ahead_underruns;
+#endif
+void chip_render_ahead_flush();
+void chip_render_ahead_resume();
+int chip_render_ahead_work(int samples);
+int chip_render_ahead_take(uint16_t *buffer, uint8_t *song_loops);
+
+// The last CHIP_TAP_LEN samples handed to Bitbox (a ring, starting at chip_tap_written % CHIP_TAP_LEN),
+// and the oscillator volumes for the latest sound buffer.  Only filled while chip_tap_enabled;
+// chip_tap_written is updated after the samples, so a reader can copy the ring and check that
+// chip_tap_written didn't change in the meantime.
+#define CHIP_TAP_LEN 512 // needs to be a power of 2
+extern uint8_t chip_tap_enabled;
+extern uint16_t chip_tap[CHIP_TAP_LEN];
+extern volatile uint32_t chip_tap_written;
+extern uint8_t chip_tap_volume[CHIP_PLAYERS];
+
+// number of times the song came to its end (and started over) since chip_play_song:
+extern uint8_t chip_song_loops;
+// if nonzero, the speakers get silence and the sound needs to be taken with chip_render_ahead_take:
+extern uint8_t chip_sound_off;
 
 #endif
@@ -0,0 +1,45 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+
+// A free-running cycle counter, for budgeting and timing work.  Differences of
+// cycles_now() are fine across the 32-bit wrap-around (about every 25 seconds).
+#define CYCLES_PER_SECOND 168000000
+// each of the 240 screen lines gets shown twice (see vga_odd), at 31469 VGA lines a second:
+#define CYCLES_PER_LINE (CYCLES_PER_SECOND/31469)
+
+#ifdef EMULATOR
+#include <time.h>
+
+static inline void cycles_init() {}
+
+static inline uint32_t cycles_now()
+{   // host time, scaled to Bitbox cycles so that budgets mean about the same thing.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec*CYCLES_PER_SECOND + (uint32_t)((uint64_t)now.tv_nsec*(CYCLES_PER_SECOND/1000000)/1000);
+}
+#else
+// Cortex-M4 debug registers, DWT_CYCCNT counts every CPU cycle once enabled:
+#define CYCLES_DEMCR (*(volatile uint32_t *)0xE000EDFC)
+#define CYCLES_DWT_CTRL (*(volatile uint32_t *)0xE0001000)
+#define CYCLES_DWT_CYCCNT (*(volatile uint32_t *)0xE0001004)
+
+static inline void cycles_init()
+{   CYCLES_DEMCR |= 1 << 24; // TRCENA
+    CYCLES_DWT_CYCCNT = 0;
+    CYCLES_DWT_CTRL |= 1; // CYCCNTENA
+}
+
+static inline uint32_t cycles_now()
+{   return CYCLES_DWT_CYCCNT;
+}
+#endif
+
+static inline int cycles_before(uint32_t deadline)
+{   // nonzero if cycles_now() hasn't reached the deadline yet.
+    return (int32_t)(deadline - cycles_now()) > 0;
+}
+
+#endif
@@ -1,15 +1,58 @@
 #include "bitbox.h"
+#include "bitmaps.h"
 #include "game.h"
+#include "landscape.h"
+#include "physics.h"
+#include "projection.h"
 #include "sprite.h"
+#include "tiles.h"
 
-#define BG_COLOR 0
+static void debugSprite_fill_tile(int tile, uint8_t color1, uint8_t color2, int pattern)
+{   // fills in a tile with a simple two-color pattern.
+    for (int y = 0; y < TILE_SIZE; ++y)
+    for (int x = 0; x < TILE_SIZE; x += 2)
+    {   uint8_t left = ((x + y) % pattern) ? color1 : color2;
+        uint8_t right = ((x + 1 + y) % pattern) ? color1 : color2;
+        tiles_graphics[tile][y][x/2] = left | (right << 4);
+    }
+}
 
 void debugSprite_reset()
-{   LL_RESET(sprite, next_to_draw, previous_to_draw, MAX_SPRITES);   
+{   sprite_init();
+    tiles_init();
+    // no terrain in front of the sprites here yet:
+    physics_reset();
+    physics_static.count = 0;
+    landscape_camera_x = 0;
+    landscape_camera_y = 0;
+    landscape_reset();
+    debugSprite_fill_tile(0, 10, 9, 7); // grass
+    debugSprite_fill_tile(1, 1, 11, 4); // stone
+    debugSprite_fill_tile(2, 14, 13, 3); // water
+    for (int j = 0; j < TILES_MAP_H; ++j)
+    for (int i = 0; i < TILES_MAP_W; ++i)
+        tiles_map[j][i] = (i/4 + j/4) % 2 ? 0 : (i + j) % 5 ? 1 : 2;
+
+    for (int k = 0; k < 4; ++k)
+    {   uint8_t index = sprite_new();
+        sprite[index].width = 24;
+        sprite[index].height = 24;
+        sprite[index].colors = 0x53 + 0x11*k;
+        sprite[index].shape = Ellipse_ThickBorder + k;
+        // standing at their bottom edge:
+        sprite_move(index, 100 + 30*k, 100 + 8*k, sprite_depth(124 + 8*k));
+    }
+    for (int k = 0; k < BITMAP_COUNT; ++k)
+    {   uint8_t index = sprite_new();
+        sprite[index].shape = Bitmap_Knight + k;
+        // in front of all but the last ellipse:
+        sprite_move(index, 110 + 40*k, 112, sprite_depth(144));
+    }
 }
 
 void debugSprite_line()
-{   memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+{   tiles_line();
+    sprite_line();
 }
 
 void debugSprite_controls()
@@ -17,15 +60,23 @@ void debugSprite_controls()
     {   game_message[0] = 0;
         if (GAMEPAD_PRESS(0, up))
             game_switch(ModeNameSong);
-        return;
     }
-    int movement = 0;
-    if (GAMEPAD_PRESSING(0, up))
-        ++movement;
-    if (GAMEPAD_PRESSING(0, down))
-        --movement;
-    if (GAMEPAD_PRESSING(0, left))
-        --movement;
-    if (GAMEPAD_PRESSING(0, right))
-        ++movement;
+    else
+    {   if (GAMEPAD_HOLDING(0, up))
+            --tiles_scroll_y;
+        if (GAMEPAD_HOLDING(0, down))
+            ++tiles_scroll_y;
+        if (GAMEPAD_HOLDING(0, left))
+            --tiles_scroll_x;
+        if (GAMEPAD_HOLDING(0, right))
+            ++tiles_scroll_x;
+    }
+    // the sprites are in the world, so they scroll along with the tiles:
+    landscape_camera_x = tiles_scroll_x;
+    landscape_camera_y = tiles_scroll_y;
+    physics_frame();
+    tiles_frame();
+    landscape_frame();
+    projection_frame();
+    sprite_frame();
 }
@@ -7,20 +7,22 @@
 #include "game.h"
 #include "io.h"
 #include "name.h"
+#include "scope.h"
+#include "text-cache.h"
 
 #include <stdlib.h> // rand
 #include <stdint.h> // rand
 
 #define BG_COLOR 5
 #define BOX_COLOR RGB(30, 20, 0)
-#define PLAY_COLOR (RGB(220, 50, 0)|(RGB(220, 50, 0)<<16))
+#define PLAY_COLOR PIXEL_PAIR(RGB(220, 50, 0), RGB(220, 50, 0))
 #define NUMBER_LINES 20
 
 uint8_t editInstrument_note;
 uint8_t editInstrument_instrument;
 uint8_t editInstrument_cmd_index;
-// TODO: WHAT DOES THIS DO:
-uint8_t show_instrument;
+// a bit for each command that gets shown, i.e. not after a break (unless starting a drum section):
+uint16_t editInstrument_shown;
 uint8_t editInstrument_bad;
 uint8_t editInstrument_copying;
 uint8_t editInstrument_cursor;
@@ -110,6 +112,9 @@ void editInstrument_load_defaults()
     chip_instrument[i].cmd[++ci] = InstrumentFadeMagnitude | (15<<4); 
     chip_instrument[i].cmd[++ci] = 0; 
     chip_instrument[i].cmd[++ci] = 0;  // that was the third (last) sub-instrument
+
+    for (i=0; i<16; ++i)
+        chip_instrument_analyze(i);
 }
 
 static void editInstrument_short_command_message(uint8_t *buffer, uint8_t cmd)
@@ -177,37 +182,37 @@ void editInstrument_render_command(int j, int y)
     cmd &= 15;
     int smash_together = 0;
 
-    uint32_t *dst = (uint32_t *)draw_buffer + x/2;
-    uint32_t color_choice[2];
+    pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + x/2;
+    pixel_pair_t color_choice[2];
     if (!chip_instrument[editInstrument_instrument].is_drum || j < 2*DRUM_SECTION_LENGTH)
     {
         if (j % 2)
-            color_choice[0] = 16843009u*BG_COLOR;
+            color_choice[0] = BYTE_PIXEL_PAIR(BG_COLOR);
         else
-            color_choice[0] = 16843009u*14;
+            color_choice[0] = BYTE_PIXEL_PAIR(14);
     }
     else if (j < 3*DRUM_SECTION_LENGTH)
     {
         if (j % 2)
-            color_choice[0] = 16843009u*41;
+            color_choice[0] = BYTE_PIXEL_PAIR(41);
         else
-            color_choice[0] = 16843009u*45;
+            color_choice[0] = BYTE_PIXEL_PAIR(45);
     }
     else
     {
         if (j % 2)
-            color_choice[0] = 16843009u*BG_COLOR;
+            color_choice[0] = BYTE_PIXEL_PAIR(BG_COLOR);
         else
-            color_choice[0] = 16843009u*9;
+            color_choice[0] = BYTE_PIXEL_PAIR(9);
     }
 
     if (j != editInstrument_cmd_index)
     {
-        color_choice[1] = 65535u*65537u;
+        color_choice[1] = BYTE_PIXEL_PAIR(255);
     }
     else
     {
-        color_choice[1] = RGB(190, 245, 255)|(RGB(190, 245, 255)<<16);
+        color_choice[1] = PIXEL_PAIR(RGB(190, 245, 255), RGB(190, 245, 255));
         if (!music_editor_in_menu)
         {
             if ((y+1)/2 == 1)
@@ -221,9 +226,9 @@ void editInstrument_render_command(int j, int y)
             else if ((y+1)/2 == 3)
             {
                 dst -= 4;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 ++dst;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 dst += 4 - 1;
             }
         }
@@ -231,15 +236,7 @@ void editInstrument_render_command(int j, int y)
     
     if (cmd == InstrumentBreak)
     {   if (param == 0)
-        {   if (y == 7)
-            {   if
-                (   j == 0 ||
-                    ((chip_instrument[editInstrument_instrument].cmd[j-1] & 15) != InstrumentRandomize)
-                )
-                {   show_instrument = 0;
-                }
-            }
-            cmd = '6';
+        {   cmd = '6';
             param = '4';
         }
         else
@@ -350,7 +347,7 @@ void editInstrument_render_command(int j, int y)
             break;
         case InstrumentNote:
             if (param >= 12)
-                color_choice[1] = RGB(150,150,255)|(65535<<16);
+                color_choice[1] = PIXEL_PAIR(RGB(150,150,255), BYTE_PIXEL(255));
             param %= 12;
             cmd = note_name[param][0];
             param = note_name[param][1];
@@ -547,19 +544,16 @@ void editInstrument_render_command(int j, int y)
         else if ((y+1)/2 == 3)
         {
             dst += 4;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
             ++dst;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
         }
     }
 }
 
-int _editInstrument_check();
-int __editInstrument_check(uint8_t j, uint8_t j_max);
-
 void editInstrument_check()
 {   // check if that parameter broke something
-    if (_editInstrument_check())
+    if (chip_instrument_analyze(editInstrument_instrument))
     {   editInstrument_bad = 1; 
         game_set_message_with_timeout("bad jump, need wait in loop.", MESSAGE_TIMEOUT);
     }
@@ -567,109 +561,11 @@ void editInstrument_check()
     {   editInstrument_bad = 0; 
         game_message[0] = 0;
     }
-    chip_player[editTrack_player].track_volume = 0;
-    chip_player[editTrack_player].track_volumed = 0;
-}
-
-int _editInstrument_check()
-{   if (chip_instrument[editInstrument_instrument].is_drum)
-    {   return __editInstrument_check(0, 2*DRUM_SECTION_LENGTH) ||
-            __editInstrument_check(2*DRUM_SECTION_LENGTH, 3*DRUM_SECTION_LENGTH) ||
-            __editInstrument_check(3*DRUM_SECTION_LENGTH, 4*DRUM_SECTION_LENGTH);
-    }
+    // keep playing with the changes, unless they would get the players stuck:
+    if (editInstrument_bad)
+        chip_kill();
     else
-        return __editInstrument_check(0, MAX_INSTRUMENT_LENGTH);
-}
-
-int __editInstrument_check(uint8_t j, uint8_t j_max)
-{   // check for a InstrumentJump which loops back on itself without waiting at least a little bit.
-    // return 1 if so, 0 if not.
-    int j_last_jump = -1;
-    int found_wait = 0;
-    for (int k=0; k<32; ++k)
-    {   if (j >= j_max) // got to the end
-        {   message("made it to end, good!\n");
-            return 0;
-        }
-        message("scanning instrument %d: line %d\n", editInstrument_instrument, j);
-        if (j_last_jump >= 0)
-        {   if (j == j_last_jump) // we found our loop-back point
-            {   message("returned to the jump\n");
-                return !(found_wait); // did we find a wait?
-            }
-            int j_next_jump = -1;
-            switch (chip_instrument[editInstrument_instrument].cmd[j]&15)
-            {   case InstrumentJump:
-                    j_next_jump = chip_instrument[editInstrument_instrument].cmd[j]>>4;
-                    if (j_next_jump == j_last_jump) // jumping forward to the original jump
-                    {   message("jumped to the old jump\n");
-                        return !(found_wait);
-                    }
-                    else if (j_next_jump > j_last_jump) // jumping past original jump
-                    {   message("This probably shouldn't happen.\n");
-                        j_last_jump = -1; // can't look for loops...
-                    }
-                    else
-                    {   message("jumped backwards again?\n");
-                        j_last_jump = j;
-                        found_wait = 0;
-                    }
-                    j = j_next_jump;
-                    break;
-                case InstrumentWait:
-                    message("saw wait at j=%d\n", j);
-                    found_wait = 1;
-                    ++j;
-                    break;
-                case InstrumentBreak:
-                    // check for a randomizer behind
-                    if
-                    (   j > 0 &&
-                        (   (chip_instrument[editInstrument_instrument].cmd[j-1] & 15)
-                            == InstrumentRandomize
-                        )
-                    )
-                    {}
-                    else if ((chip_instrument[editInstrument_instrument].cmd[j]>>4) == 0)
-                        return 0;
-                    // fall through to ++j
-                default:
-                    ++j;
-            }
-        }
-        else switch (chip_instrument[editInstrument_instrument].cmd[j]&15)
-        {   case InstrumentJump:
-                j_last_jump = j;
-                j = chip_instrument[editInstrument_instrument].cmd[j]>>4;
-                if (j > j_last_jump)
-                {   message("This probably shouldn't happen??\n");
-                    j_last_jump = -1; // don't care, we moved ahead
-                }
-                else if (j == j_last_jump)
-                {   message("jumped to itself\n");
-                    return 1; // this is bad
-                }
-                else
-                    found_wait = 0;
-                break;
-            case InstrumentBreak:
-                // check for a randomizer behind
-                if
-                (   j > 0 &&
-                    (   (chip_instrument[editInstrument_instrument].cmd[j-1]&15)
-                        == InstrumentRandomize
-                    )
-                )
-                {}
-                else if ((chip_instrument[editInstrument_instrument].cmd[j]>>4) == 0)
-                    return 0;
-                // fall through to ++j
-            default:
-                ++j;
-        }
-    }
-    message("couldn't finish after iterations. congratulations.\nprobably looping back on self, but with waits.");
-    return 0;
+        chip_hot_patch();
 }
 
 void editInstrument_adjust_parameter(int direction)
@@ -685,6 +581,61 @@ void editInstrument_adjust_parameter(int direction)
     editInstrument_check();
 }
 
+void editInstrument_frame()
+{   // Call every frame after the controls; works out which text rows need drawing again.
+    STATIC_ASSERT(NUMBER_LINES == TEXT_CACHE_ROWS);
+    const uint8_t *cmd = chip_instrument[editInstrument_instrument].cmd;
+    const uint8_t is_drum = chip_instrument[editInstrument_instrument].is_drum;
+    editInstrument_shown = 0;
+    int show = 1;
+    for (int j = 0; j < MAX_INSTRUMENT_LENGTH; ++j)
+    {   // drum sections start showing commands again (on lines 10 and 14):
+        if (is_drum && (j == 2*DRUM_SECTION_LENGTH || j == 3*DRUM_SECTION_LENGTH))
+            show = 1;
+        if (!show)
+            continue;
+        editInstrument_shown |= 1 << j;
+        if (cmd[j] == InstrumentBreak && (j == 0 || (cmd[j-1]&15) != InstrumentRandomize))
+            show = 0;
+    }
+    // same as the instrument position indicator in editInstrument_render_command:
+    int play_index = -1;
+    if (chip_player[editTrack_player].track_volume)
+    {   play_index = chip_player[editTrack_player].cmd_index;
+        if (play_index && (cmd[play_index-1]&15) == InstrumentWait)
+            --play_index;
+    }
+    // everything the text next to the commands depends on:
+    uint32_t status = TEXT_CACHE_SIGNATURE;
+    status = textCache_mix(status, editInstrument_cmd_index);
+    status = textCache_mix(status, cmd[editInstrument_cmd_index]);
+    status = textCache_mix(status, music_editor_in_menu);
+    status = textCache_mix(status, editInstrument_copying < 16);
+    status = textCache_mix(status, editInstrument_bad);
+
+    for (int line = 0; line < NUMBER_LINES; ++line)
+    {   uint32_t signature = TEXT_CACHE_SIGNATURE;
+        if (line == 0)
+        {   signature = textCache_mix(signature, editInstrument_instrument);
+            signature = textCache_mix(signature, chip_instrument[editInstrument_instrument].octave);
+            signature = textCache_mix(signature, is_drum);
+        }
+        else if (line >= 2 && line < 18)
+        {   int j = line-2;
+            signature = textCache_mix(status, j);
+            signature = textCache_mix(signature, cmd[j]);
+            signature = textCache_mix(signature, is_drum);
+            signature = textCache_mix(signature, j == editInstrument_cmd_index);
+            signature = textCache_mix(signature, (editInstrument_shown >> j) & 1);
+            signature = textCache_mix(signature, j == play_index);
+        }
+        else if (line == 19)
+        {   signature = textCache_mix(signature, GAMEPAD_HOLDING(0, select) != 0);
+        }
+        textCache_sign(line, signature);
+    }
+}
+
 // TODO: make sure to show all commands, even if they are past a break.
 // we can jump to those locations.  maybe make them gray.
 void editInstrument_line()
@@ -693,7 +644,7 @@ void editInstrument_line()
     {
         if (vga_line/2 == 0)
         {
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
             return;
         }
         return;
@@ -701,18 +652,23 @@ void editInstrument_line()
     else if (vga_line >= 16 + NUMBER_LINES*10)
     {
         if (vga_line/2 == (16 +NUMBER_LINES*10)/2)
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     int line = (vga_line-16) / 10;
     int internal_line = (vga_line-16) % 10;
+    if (line == 1)
+    {   // the row under the title shows the sound being played
+        scope_line(internal_line, BYTE_PIXEL(BG_COLOR));
+        return;
+    }
     if (internal_line == 0 || internal_line == 9)
     {
-        memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+        memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         if (music_editor_in_menu && line == 0)
         {
-            uint16_t *dst = draw_buffer + (22 + editInstrument_cursor*7) * 9 - 1;
-            const uint16_t color = BOX_COLOR;
+            pixel_t *dst = draw_buffer + (22 + editInstrument_cursor*7) * 9 - 1;
+            const pixel_t color = BOX_COLOR;
             *dst++ = color;
             *dst++ = color;
             *dst++ = color;
@@ -724,7 +680,13 @@ void editInstrument_line()
         }
         return;
     }
+    if (line == 2 && internal_line == 1)
+    {   // the scope only got cleared out of the other line buffer:
+        memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
+    }
     --internal_line;
+    if (textCache_line(line, internal_line))
+        return;
     uint8_t buffer[24];
     switch (line)
     {
@@ -738,27 +700,23 @@ void editInstrument_line()
                 ' ', 'd', 'r', 'u', 'm', ' ',
                 (chip_instrument[editInstrument_instrument].is_drum ? 'Y' : 'N'),
             0 };
-            font_render_line_doubled(msg, 16, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 16, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 1:
             break;
         case 2:
         {
-            show_instrument = 1; 
             editInstrument_render_command(line-2, internal_line);
             // command
             uint8_t msg[] = { 'c', 'o', 'm', 'm', 'a', 'n', 'd', ' ', hex_character[editInstrument_cmd_index], ':', 0 };
-            font_render_line_doubled(msg, 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 10:
         case 14:
-            if (chip_instrument[editInstrument_instrument].is_drum || show_instrument)
-            {
-                show_instrument = 1; 
+            if (editInstrument_shown & (1 << (line-2)))
                 editInstrument_render_command(line-2, internal_line);
-            }
             break;
         case 3:
         {   uint8_t cmd_param = chip_instrument[editInstrument_instrument].cmd[editInstrument_cmd_index];
@@ -863,7 +821,7 @@ void editInstrument_line()
                     strcpy((char *)buffer, "jump to command");
                     break;
             }
-            font_render_line_doubled(buffer, 102, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(buffer, 102, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         }
         case 4:
@@ -889,101 +847,102 @@ void editInstrument_line()
                 }
                 msg[8] = hex_character[(chip_instrument[editInstrument_instrument].cmd[editInstrument_cmd_index]/16)%4];
                 msg[9] = 0;
-                font_render_line_doubled(msg, 156, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(msg, 156, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_instrument;
         case 5:
-            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257); 
+            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)); 
             goto maybe_show_instrument;
         case 6:
             if (music_editor_in_menu)
             {
-                font_render_line_doubled((uint8_t *)"L:prev instrument", 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"L:prev instrument", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 buffer[0] = 'L'; buffer[1] = ':';
                 editInstrument_short_command_message(buffer+2, chip_instrument[editInstrument_instrument].cmd[editInstrument_cmd_index]-1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_instrument;
         case 7:
             if (music_editor_in_menu)
             {
-                font_render_line_doubled((uint8_t *)"R:next instrument", 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"R:next instrument", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 buffer[0] = 'R'; buffer[1] = ':';
                 editInstrument_short_command_message(buffer+2, chip_instrument[editInstrument_instrument].cmd[editInstrument_cmd_index]+1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_instrument;
         case 8:
-            font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         case 9:
-            font_render_line_doubled((uint8_t *)"adjust parameters", 112, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"adjust parameters", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         case 11:
             if (music_editor_in_menu)
             {
                 if (editInstrument_copying < 16)
-                    font_render_line_doubled((uint8_t *)"A:cancel copy", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"A:cancel copy", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                 else if (!editInstrument_bad)
-                    font_render_line_doubled((uint8_t *)"A:save to file", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"A:save to file", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
-                font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         case 12:
             if (music_editor_in_menu)
             {
                 if (editInstrument_copying < 16)
-                    font_render_line_doubled((uint8_t *)"B/X:\"     \"", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"B/X:\"     \"", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
 
                 else
-                    font_render_line_doubled((uint8_t *)"B:load from file", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"B:load from file", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
-                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         case 13:
             if (music_editor_in_menu)
             {
                 if (editInstrument_copying < 16)
-                    font_render_line_doubled((uint8_t *)"Y:paste", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"Y:paste", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
 
                 else if (!editInstrument_bad)
-                    font_render_line_doubled((uint8_t *)"X:copy", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"X:copy", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 if (!editInstrument_bad)
-                    font_render_line_doubled((uint8_t *)"A/B:play note", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"A/B:play note", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_instrument;
         case 15:
             goto maybe_show_instrument;
         case 17:
             if (music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"start:edit instrument", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:edit instrument", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             else
-                font_render_line_doubled((uint8_t *)"start:instrument menu", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:instrument menu", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_instrument;
         case 18:
-            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 19:
             if (GAMEPAD_HOLDING(0, select))
-                font_render_line_doubled((uint8_t *)"> song < track ^ up", 100, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"> song < track ^ up", 100, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         default:
           maybe_show_instrument:
-            if (show_instrument)
+            if (editInstrument_shown & (1 << (line-2)))
                 editInstrument_render_command(line-2, internal_line);
             break; 
     }
+    textCache_capture(line, internal_line, BYTE_PIXEL(BG_COLOR));
 }
 
 static inline void editInstrument_menu_controls()
@@ -1009,6 +968,8 @@ static inline void editInstrument_menu_controls()
                 chip_instrument[editInstrument_instrument].is_drum = 0;
             else
                 chip_instrument[editInstrument_instrument].is_drum = 1;
+            // the drum sections change where the commands can run to:
+            editInstrument_check();
         }
         else
         {
@@ -1076,6 +1037,7 @@ static inline void editInstrument_menu_controls()
             chip_instrument[editInstrument_instrument].octave = chip_instrument[editInstrument_copying].octave;
             chip_instrument[editInstrument_instrument].is_drum = chip_instrument[editInstrument_copying].is_drum;
             memcpy(dst, src, MAX_INSTRUMENT_LENGTH);
+            chip_instrument_analyze(editInstrument_instrument);
             game_set_message_with_timeout("pasted.", MESSAGE_TIMEOUT); 
             editInstrument_copying = 16;
         }
@@ -10,6 +10,7 @@ extern uint8_t editInstrument_cmd_index;
 void editInstrument_init();
 void editInstrument_load_defaults();
 void editInstrument_controls();
+void editInstrument_frame();
 void editInstrument_line();
 
 #endif
@@ -8,14 +8,16 @@
 #include "io.h"
 #include "name.h"
 #include "sprite.h"
+#include "task.h"
+#include "text-cache.h"
 
 #include <stdlib.h> // rand
 
 #define BG_COLOR 128
 // TODO: make unique from edit-track.c:
-#define PLAY_COLOR (RGB(200, 100, 0)|(RGB(200, 100, 0)<<16))
-#define BOX_COLOR (RGB(180, 250, 180)|(RGB(180, 250, 180)<<16))
-#define MATRIX_WING_COLOR (RGB(30, 90, 30) | (RGB(30, 90, 30)<<16))
+#define PLAY_COLOR PIXEL_PAIR(RGB(200, 100, 0), RGB(200, 100, 0))
+#define BOX_COLOR PIXEL_PAIR(RGB(180, 250, 180), RGB(180, 250, 180))
+#define MATRIX_WING_COLOR PIXEL_PAIR(RGB(30, 90, 30), RGB(30, 90, 30))
 #define NUMBER_LINES 20
 
 uint8_t music_editor_in_menu CCM_MEMORY;
@@ -46,9 +48,11 @@ uint8_t editSong_pos;
 uint8_t editSong_bad;
 uint8_t editSong_offset;
 uint8_t editSong_command_copy;
-uint8_t editSong_command_appears_reachable;
+// commands from here on (i.e. after the first break on screen) don't look reachable:
+uint16_t editSong_reachable_end;
 
 static void editSong_save_or_load_all(io_event_t save_or_load);
+static task_result_t editSong_save_or_load_step();
 
 void editSong_start(int load_song)
 {   editSong_bad = 0;
@@ -58,6 +62,7 @@ void editSong_start(int load_song)
     else
     {   chip_song_cmd[0] = SongPlayTracksForCount;
         chip_song_cmd[1] = SongBreak;
+        chip_song_analyze();
     }
     editSong_pos = 0;
     editSong_offset = 0;
@@ -66,7 +71,6 @@ void editSong_start(int load_song)
 
 void editSong_render_command(int j, int y)
 {   int x = 20;
-    uint8_t next_command_will_be_reachable = editSong_command_appears_reachable;
     #ifdef EMULATOR
     if (y < 0 || y >= 8)
     {
@@ -81,17 +85,17 @@ void editSong_render_command(int j, int y)
     cmd &= 15;
 
     ASSERT((x/2)%2 == 0);
-    uint32_t *dst = (uint32_t *)draw_buffer + x/2;
-    uint32_t color_choice[2];
+    pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + x/2;
+    pixel_pair_t color_choice[2];
     if (j%2)
-        color_choice[0] = 16843009u*BG_COLOR;
+        color_choice[0] = BYTE_PIXEL_PAIR(BG_COLOR);
     else
-        color_choice[0] = 16843009u*149;
+        color_choice[0] = BYTE_PIXEL_PAIR(149);
     
     if (j != editSong_pos)
-        color_choice[1] = 65535u*65537u;
+        color_choice[1] = BYTE_PIXEL_PAIR(255);
     else
-    {   color_choice[1] = RGB(190, 245, 255)|(RGB(190, 245, 255)<<16);
+    {   color_choice[1] = PIXEL_PAIR(RGB(190, 245, 255), RGB(190, 245, 255));
         if (!music_editor_in_menu)
         {   // draw a little dot indicating your edit cursor is at this command
             if ((y+1)/2 == 1)
@@ -103,9 +107,9 @@ void editSong_render_command(int j, int y)
             }
             else if ((y+1)/2 == 3)
             {   dst -= 4;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 ++dst;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 dst += 4 - 1;
             }
         }
@@ -115,8 +119,6 @@ void editSong_render_command(int j, int y)
     {   case SongBreak:
             cmd = 'Q';
             param = hex_character[param];
-            if (y == 7)
-                next_command_will_be_reachable = 0;
             break;
         case SongVolume:
             cmd = 'V';
@@ -255,49 +257,34 @@ void editSong_render_command(int j, int y)
             param = hex_character[param];
             break;
     }
-    if (!editSong_command_appears_reachable)
+    if (j >= editSong_reachable_end)
     {   // change the command's colors so it doesn't look easily reachable
         // TODO: do this for instrument and verse 
-        uint32_t swapper = ~color_choice[0];
+        pixel_pair_t swapper = ~color_choice[0];
         color_choice[0] = ~color_choice[1];
         color_choice[1] = swapper;
     }
-    editSong_command_appears_reachable = next_command_will_be_reachable;
-    
     uint8_t shift = ((y/2))*4;
-    uint8_t row = (font[hex_character[j/16]] >> shift) & 15;
+    font_wide_t wide[4];
+    font_wide_colors(wide, color_choice);
     *(++dst) = color_choice[0];
-    for (int k=0; k<4; ++k)
-    {   *(++dst) = color_choice[row&1];
-        row >>= 1;
-    }
+    font_render_wide_row(dst + 1, font[hex_character[j/16]] >> shift, wide);
+    dst += 4;
     *(++dst) = color_choice[0];
-    row = (font[hex_character[j%16]] >> shift) & 15;
     *(++dst) = color_choice[0];
-    for (int k=0; k<4; ++k)
-    {   *(++dst) = color_choice[row&1];
-        row >>= 1;
-    }
+    font_render_wide_row(dst + 1, font[hex_character[j%16]] >> shift, wide);
+    dst += 4;
     *(++dst) = color_choice[0];
-    row = (font[':'] >> shift) & 15;
-    for (int k=0; k<4; ++k)
-    {   *(++dst) = color_choice[row&1];
-        row >>= 1;
-    }
+    font_render_wide_row(dst + 1, font[':'] >> shift, wide);
+    dst += 4;
     *(++dst) = color_choice[0];
     *(++dst) = color_choice[0];
-    row = (font[cmd] >> shift) & 15;
-    for (int k=0; k<4; ++k)
-    {   *(++dst) = color_choice[row&1];
-        row >>= 1;
-    }
+    font_render_wide_row(dst + 1, font[cmd] >> shift, wide);
+    dst += 4;
     *(++dst) = color_choice[0];
     
-    row = (font[param] >> shift) & 15;
-    for (int k=0; k<4; ++k)
-    {   *(++dst) = color_choice[row&1];
-        row >>= 1;
-    }
+    font_render_wide_row(dst + 1, font[param] >> shift, wide);
+    dst += 4;
     *(++dst) = color_choice[0];
   
     if (chip_playing != PlayingSong)
@@ -320,18 +307,16 @@ void editSong_render_command(int j, int y)
         else if ((y+1)/2 == 3)
         {
             dst += 4;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
             ++dst;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
         }
     }
 }
 
-int _editSong_check();
-
 void editSong_check()
 {   // check if that parameter broke something
-    if (_editSong_check())
+    if (chip_song_analyze())
     {   editSong_bad = 1; 
         game_set_message_with_timeout("bad jump, need wait in loop.", MESSAGE_TIMEOUT);
     }
@@ -339,87 +324,11 @@ void editSong_check()
     {   editSong_bad = 0; 
         game_message[0] = 0;
     }
-}
-
-int _editSong_check()
-{   // check for a JUMP which loops back on itself without waiting at least a little bit.
-    // return 1 if so, 0 if not.
-    int j=0; // current command index
-    int j_last_jump = -1;
-    int found_wait = 0;
-    for (int k=0; k<257; ++k)
-    {   if (j >= 256) // got to the end
-            return !(found_wait);
-        uint8_t command = chip_song_cmd[j];
-        if (j_last_jump >= 0)
-        {   if (j == j_last_jump) // we found our loop-back point
-                return !(found_wait); // did we find a wait?
-            int j_next_jump = -1;
-            switch (command & 15)
-            {   case SongJump:
-                    j_next_jump = 16*(command >> 4);
-                    if (j_next_jump == j_last_jump) // jumping forward to the original jump
-                    {   message("jumped to the old jump\n");
-                        return !(found_wait);
-                    }
-                    else if (j_next_jump > j_last_jump) // jumping past original jump
-                    {   message("This probably shouldn't happen.\n");
-                        j_last_jump = -1; // can't look for loops...
-                    }
-                    else
-                    {   message("jumped backwards again?\n");
-                        j_last_jump = j;
-                        found_wait = 0;
-                    }
-                    j = j_next_jump;
-                    break;
-                case SongPlayTracksForCount:
-                    message("saw wait at j=%d\n", j);
-                    found_wait = 1;
-                    ++j;
-                    break;
-                case SongBreak:
-                    // check for a randomizer behind
-                    if (j > 0 && (chip_song_cmd[j-1]&15) == SongRandomize)
-                    {}
-                    else if (command>>4)
-                        return 0;
-                    j = 0;
-                    break;
-                default:
-                    ++j;
-            }
-        }
-        else
-        switch (command & 15)
-        {   case SongJump:
-                j_last_jump = j;
-                j = 16*(command >> 4);
-                if (j > j_last_jump)
-                {   message("This probably shouldn't happen??\n");
-                    j_last_jump = -1; // don't care, we moved ahead
-                }
-                else if (j == j_last_jump)
-                {   message("jumped to itself\n");
-                    return 1; // this is bad
-                }
-                else
-                    found_wait = 0;
-                break;
-            case SongBreak:
-                // check for a randomizer behind
-                if (j > 0 && (chip_song_cmd[j-1] & 15) == SongRandomize)
-                {}
-                else if (command >> 4)
-                    return 0;
-                j = 0;
-                break;
-            default:
-                ++j;
-        }
-    }
-    message("couldn't finish after 257 iterations. congratulations.\nprobably looping back on self, but with waits.");
-    return 0;
+    // keep playing with the changes, unless they would get the song stuck:
+    if (editSong_bad)
+        chip_kill();
+    else
+        chip_hot_patch();
 }
 
 void editSong_short_command_message(uint8_t *buffer, uint8_t cmd)
@@ -475,26 +384,76 @@ void editSong_short_command_message(uint8_t *buffer, uint8_t cmd)
     }
 }
 
+void editSong_frame()
+{   // Call every frame after the controls; works out which text rows need drawing again.
+    STATIC_ASSERT(NUMBER_LINES == TEXT_CACHE_ROWS);
+    editSong_reachable_end = MAX_SONG_LENGTH;
+    for (int j = editSong_offset; j < editSong_offset + 16; ++j)
+    if ((chip_song_cmd[j]&15) == SongBreak)
+    {   editSong_reachable_end = j + 1;
+        break;
+    }
+    // same as the song position indicator in editSong_render_command:
+    int play_index = -1;
+    if (chip_playing == PlayingSong)
+    {   play_index = chip_song_cmd_index;
+        if (play_index && ((chip_song_cmd[play_index-1]&15) == SongPlayTracksForCount))
+            --play_index;
+    }
+    // everything the text next to the commands depends on:
+    uint32_t status = TEXT_CACHE_SIGNATURE;
+    status = textCache_mix(status, editSong_pos);
+    status = textCache_mix(status, chip_song_cmd[editSong_pos]);
+    status = textCache_mix(status, music_editor_in_menu);
+    status = textCache_mix(status, chip_playing);
+
+    for (int line = 0; line < NUMBER_LINES; ++line)
+    {   uint32_t signature = TEXT_CACHE_SIGNATURE;
+        if (line == 0)
+        {   signature = textCache_mix(signature, chip_playing && (track_pos/4 % 2==0));
+            signature = textCache_mix(signature, song_transpose);
+            signature = textCache_mix(signature, song_speed);
+            signature = textCache_mix(signature, chip_track_playtime);
+            signature = textCache_mix(signature, chip_song_variable_A);
+            signature = textCache_mix(signature, chip_song_variable_B);
+        }
+        else if (line >= 2 && line < 18)
+        {   int j = editSong_offset+line-2;
+            signature = textCache_mix(status, j);
+            signature = textCache_mix(signature, chip_song_cmd[j]);
+            signature = textCache_mix(signature, j == editSong_pos);
+            signature = textCache_mix(signature, j >= editSong_reachable_end);
+            signature = textCache_mix(signature, j == play_index);
+        }
+        else if (line == 18)
+        {   signature = textCache_mix(signature, GAMEPAD_HOLDING(0, select) != 0);
+        }
+        textCache_sign(line, signature);
+    }
+}
+
 void editSong_line()
 {   if (vga_line < 16)
     {   if (vga_line/2 == 0)
-        {   memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+        {   memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
             return;
         }
         return;
     }
     else if (vga_line >= 16 + NUMBER_LINES*10)
     {   if (vga_line/2 == (16 +NUMBER_LINES*10)/2)
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     int line = (vga_line-16) / 10;
     int internal_line = (vga_line-16) % 10;
     if (internal_line == 0 || internal_line == 9)
-    {   memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+    {   memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     --internal_line;
+    if (textCache_line(line, internal_line))
+        return;
     uint8_t buffer[32];
     switch (line)
     {   case 0:
@@ -509,21 +468,20 @@ void editSong_line()
                 ' ', 'b', '=', hex_character[chip_song_variable_B],
                 0
             };
-            font_render_line_doubled(msg, 12, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 12, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 1:
             break;
         case 2:
-        {   editSong_command_appears_reachable = 1; 
-            editSong_render_command(editSong_offset+line-2, internal_line);
+        {   editSong_render_command(editSong_offset+line-2, internal_line);
             // command
             uint8_t msg[] =
             {   'c', 'o', 'm', 'm', 'a', 'n', 'd', ' ',
                 hex_character[editSong_pos/16], hex_character[editSong_pos%16], ':',
                 0
             };
-            font_render_line_doubled(msg, 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 3:
@@ -578,7 +536,7 @@ void editSong_line()
                     msg = "jump to cmd index";
                     break;
             }
-            font_render_line_doubled((const uint8_t *)msg, 102, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)msg, 102, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         }
         case 4:
@@ -619,7 +577,7 @@ void editSong_line()
                     }
                     *--msg_writable = 0;
                     font_render_line_doubled
-                    (   buffer, 120, internal_line, 65535, BG_COLOR*257
+                    (   buffer, 120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)
                     );
                     break;
                 }
@@ -675,45 +633,45 @@ void editSong_line()
                             msg = "--a if a > 0";
                             break;
                     }
-                    font_render_line_doubled((const uint8_t *)msg, 120, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((const uint8_t *)msg, 120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                     break;
                 }
             }
             goto draw_song_command;
         }
         case 5:
-            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257); 
+            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)); 
             goto draw_song_command;
         case 6:
             if (music_editor_in_menu)
-            {   font_render_line_doubled((uint8_t *)"L:prev track", 112, internal_line, 65535, BG_COLOR*257);
+            {   font_render_line_doubled((uint8_t *)"L:prev track", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {   buffer[0] = 'L'; buffer[1] = ':';
                 editSong_short_command_message(buffer+2, chip_song_cmd[editSong_pos]-1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto draw_song_command;
         case 7:
             if (music_editor_in_menu)
             {
-                font_render_line_doubled((uint8_t *)"R:next track", 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"R:next track", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 buffer[0] = 'R'; buffer[1] = ':';
                 editSong_short_command_message(buffer+2, chip_song_cmd[editSong_pos]+1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto draw_song_command;
         case 8:
             if (!music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         case 9:
             if (!music_editor_in_menu)
             {   font_render_line_doubled
-                (   (const uint8_t *)"adjust parameters", 112, internal_line, 65535, BG_COLOR*257
+                (   (const uint8_t *)"adjust parameters", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)
                 );
             }
             goto draw_song_command;
@@ -728,7 +686,7 @@ void editSong_line()
             else
             {   msg = "A:play song from start";
             }
-            font_render_line_doubled((const uint8_t *)msg, 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)msg, 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         }
         case 12:
@@ -739,30 +697,32 @@ void editSong_line()
             else if (!chip_playing)
             {   msg = "B:play song from here";
             }
-            font_render_line_doubled((const uint8_t *)msg, 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)msg, 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         }
         case 13:
             if (!music_editor_in_menu)
-            {   font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, 65535, BG_COLOR*257);
+            {   font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto draw_song_command;
         case 14:
-            if (!music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, 65535, BG_COLOR*257);
+            if (music_editor_in_menu)
+                font_render_line_doubled((uint8_t *)"Y:export wav", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
+            else
+                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         case 16:
             if (music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"start:edit song", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:edit song", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             else
-                font_render_line_doubled((uint8_t *)"start:song menu", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:song menu", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         case 17:
-            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto draw_song_command;
         case 18:
             if (GAMEPAD_HOLDING(0, select))
-                font_render_line_doubled((uint8_t *)"> track < inst ^ up", 100, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"> track < inst ^ up", 100, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 19:
             break;
@@ -771,10 +731,27 @@ void editSong_line()
             editSong_render_command(editSong_offset+line-2, internal_line);
             break; 
     }
+    textCache_capture(line, internal_line, BYTE_PIXEL(BG_COLOR));
 }
 
 void editSong_controls()
-{   if (GAMEPAD_HOLDING(0, select))
+{   if (task_running(&task_frame, editSong_save_or_load_step))
+    {   // nothing else until everything is saved or loaded:
+        return;
+    }
+    if (io_exporting)
+    {   // nothing else until the export is done:
+        io_error_t error;
+        if (GAMEPAD_PRESS(0, B))
+        {   io_export_song_cancel();
+            game_set_message_with_timeout("export cancelled.", MESSAGE_TIMEOUT);
+        }
+        else if ((error = io_export_song_continue()))
+            io_message_from_error(game_message, error, IoEventSave);
+        return;
+    }
+
+    if (GAMEPAD_HOLDING(0, select))
     {   if (editSong_bad)
         {   strcpy((char *)game_message, "fix jump first");
             return;
@@ -801,6 +778,8 @@ void editSong_controls()
         }
 
         int movement = 0;
+        if (GAMEPAD_PRESSING(0, L) || GAMEPAD_PRESSING(0, R))
+            chip_render_ahead_flush();
         if (GAMEPAD_PRESSING(0, L))
         {   if (chip_volume > 4)
                 chip_volume -= 4;
@@ -830,6 +809,16 @@ void editSong_controls()
             io_message_from_error(game_message, io_load_song(), IoEventLoad);
             return;
         }
+
+        if (GAMEPAD_PRESS(0, Y))
+        {   // render the song to a WAV file
+            io_error_t error = io_export_song_start();
+            if (error)
+                io_message_from_error(game_message, error, IoEventSave);
+            else
+                strcpy((char *)game_message, "exporting wav, B:cancel");
+            return;
+        }
     }  
     else
     {   // editing, not menu
@@ -938,60 +927,39 @@ void editSong_controls()
     }
 }
 
-static void editSong_save_or_load_all(io_event_t save_or_load)
-{   io_error_t error;
-    if (save_or_load == IoEventSave)
-    {   // Split up saving into different pieces;
-        // The bitbox struggles to save all at once.
-        error = io_save_song();
-        if (error)
-        {   strcpy((char *)game_message, "song ");
-            io_message_from_error(game_message+5, error, IoEventSave);
-            return;
-        }
-        error = io_save_track(MAX_TRACKS);
-
-        if (error)
-        {   strcpy((char *)game_message, "track ");
-            io_message_from_error(game_message+6, error, IoEventSave);
-            return;
-        }
-
-        error = io_save_instrument(16);
-        if (error)
-        {   strcpy((char *)game_message, "instr. ");
-            io_message_from_error(game_message+7, error, IoEventSave);
-        }
-        else
-            io_message_from_error(game_message, IoNoError, IoEventSave);
+static task_result_t editSong_save_or_load_step()
+{   // Saves or loads a piece of the song file, as a task (see editSong_save_or_load_all);
+    // the bitbox struggles to save all at once.
+    io_event_t save_or_load = io_all_event;
+    if (save_or_load == IoEventNone)
+    {   // the last step, check the song that got saved or loaded:
+        game_set_message_with_timeout(NULL, 1000);
+        editSong_check();
+        return TaskDone;
     }
-    else if (save_or_load == IoEventLoad)
-    {   // Load all pieces separately to avoid taxing bitbox too much.
-        error = io_load_song();
-        if (error)
-        {   strcpy((char *)game_message, "song ");
-            io_message_from_error(game_message+5, error, IoEventLoad);
-            return;
-        }
-
-        error = io_load_track(MAX_TRACKS);
-        if (error)
-        {   strcpy((char *)game_message, "track ");
-            io_message_from_error(game_message+6, error, IoEventLoad);
-            return;
-        }
-
-        error = io_load_instrument(16);
-        if (error)
-        {   strcpy((char *)game_message, "instr. ");
-            io_message_from_error(game_message+7, error, IoEventLoad);
-        }
-        else
-            io_message_from_error(game_message, IoNoError, IoEventLoad);
+    io_error_t error = io_all_continue();
+    if (error)
+    {   const char *piece = io_all_piece_name();
+        strcpy((char *)game_message, piece);
+        io_message_from_error(game_message+strlen(piece), error, save_or_load);
+        return TaskDone;
     }
-    else
-        message("invalid save_or_load for editSong_save_or_load_all()\n");
+    if (io_all_event == IoEventNone)
+        io_message_from_error(game_message, IoNoError, save_or_load);
+    return TaskMore;
+}
 
-    game_set_message_with_timeout(NULL, 1000);
-    editSong_check();
+static void editSong_save_or_load_all(io_event_t save_or_load)
+{   // Starts saving or loading everything, which happens over the next few frames.
+    if (task_running(&task_frame, editSong_save_or_load_step))
+        return;
+    if (save_or_load == IoEventLoad)
+        chip_kill();
+    io_error_t error = io_all_start(save_or_load);
+    if (error)
+    {   io_message_from_error(game_message, error, save_or_load);
+        return;
+    }
+    game_set_message_with_timeout(save_or_load == IoEventSave ? "saving..." : "loading...", 0);
+    task_start(&task_frame, editSong_save_or_load_step);
 }
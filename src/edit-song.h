@@ -9,6 +9,7 @@ extern const uint8_t note_name[12][2];
 
 void editSong_start(int load_song);
 void editSong_controls();
+void editSong_frame();
 void editSong_line();
 
 #endif
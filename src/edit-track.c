@@ -6,23 +6,24 @@
 #include "font.h"
 #include "game.h"
 #include "name.h"
+#include "scope.h"
 #include "io.h"
+#include "text-cache.h"
 
 #include <stdlib.h> // rand
 
 #define BG_COLOR 132
-#define PLAY_COLOR (RGB(200, 100, 0)|(RGB(200, 100, 0)<<16))
-#define BOX_COLOR (RGB(200, 200, 230)|(RGB(200, 200, 230)<<16))
-#define MATRIX_WING_COLOR (RGB(30, 90, 90) | (RGB(30, 90, 90)<<16))
+#define PLAY_COLOR PIXEL_PAIR(RGB(200, 100, 0), RGB(200, 100, 0))
+#define BOX_COLOR PIXEL_PAIR(RGB(200, 200, 230), RGB(200, 200, 230))
+#define MATRIX_WING_COLOR PIXEL_PAIR(RGB(30, 90, 90), RGB(30, 90, 90))
 #define NUMBER_LINES 20
 
 uint8_t editTrack_track;
 uint8_t editTrack_pos;
 uint8_t editTrack_offset;
 uint8_t editTrack_copying;
-// keeps track of whether to continue showing track commands.  set to 1 at top
-// and set to zero if you encounter a break.
-uint8_t editTrack_show_track;
+// commands from here on don't get shown, i.e. the ones after the first break on screen:
+uint8_t editTrack_show_end;
 uint8_t editTrack_player;
 uint8_t editTrack_command_copy;
 uint8_t editTrack_bad;
@@ -120,18 +121,18 @@ void editTrack_render_command(int j, int y)
     uint8_t param = cmd>>4;
     cmd &= 15;
 
-    uint32_t *dst = (uint32_t *)draw_buffer + x/2;
-    uint32_t color_choice[2];
+    pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + x/2;
+    pixel_pair_t color_choice[2];
     if (j%2)
-        color_choice[0] = 16843009u*BG_COLOR;
+        color_choice[0] = BYTE_PIXEL_PAIR(BG_COLOR);
     else
-        color_choice[0] = 16843009u*149;
+        color_choice[0] = BYTE_PIXEL_PAIR(149);
     
     if (j != editTrack_pos)
-        color_choice[1] = 65535u*65537u;
+        color_choice[1] = BYTE_PIXEL_PAIR(255);
     else
     {
-        color_choice[1] = RGB(190, 245, 255)|(RGB(190, 245, 255)<<16);
+        color_choice[1] = PIXEL_PAIR(RGB(190, 245, 255), RGB(190, 245, 255));
         if (!music_editor_in_menu)
         {
             if ((y+1)/2 == 1)
@@ -145,9 +146,9 @@ void editTrack_render_command(int j, int y)
             else if ((y+1)/2 == 3)
             {
                 dst -= 4;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 ++dst;
-                *dst = 16843009u*BG_COLOR;
+                *dst = BYTE_PIXEL_PAIR(BG_COLOR);
                 dst += 4 - 1;
             }
         }
@@ -156,16 +157,7 @@ void editTrack_render_command(int j, int y)
     switch (cmd)
     {   case TrackBreak:
             if (param == 0)
-            {   if
-                (   y == 7 && 
-                    (   j == 0 ||
-                        (   chip_track[editTrack_track][editTrack_player][j-1]&15
-                        )   != TrackRandomize
-                    )
-                )
-                {   editTrack_show_track = 0;
-                }
-                cmd = '0';
+            {   cmd = '0';
                 param = '0';
             }
             else
@@ -218,7 +210,7 @@ void editTrack_render_command(int j, int y)
             break;
         case TrackNote:
             if (param >= 12)
-                color_choice[1] = RGB(150,150,255)|(65535<<16);
+                color_choice[1] = PIXEL_PAIR(RGB(150,150,255), BYTE_PIXEL(255));
             param %= 12;
             cmd = note_name[param][0];
             param = note_name[param][1];
@@ -231,7 +223,7 @@ void editTrack_render_command(int j, int y)
                 param = 'g';
             break;
         case TrackArpNote:
-            color_choice[1] = RGB(150,255,150)|(65535<<16);
+            color_choice[1] = PIXEL_PAIR(RGB(150,255,150), BYTE_PIXEL(255));
             if (param >= 12)
             {   switch (param)
                 {   case ArpPlayLowNote:
@@ -354,18 +346,16 @@ void editTrack_render_command(int j, int y)
         else if ((y+1)/2 == 3)
         {
             dst += 4;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
             ++dst;
-            *dst = 16843009u*BG_COLOR;
+            *dst = BYTE_PIXEL_PAIR(BG_COLOR);
         }
     }
 }
 
-int _editTrack_check();
-
 void editTrack_check()
 {   // check if that parameter broke something
-    if (_editTrack_check())
+    if (chip_track_analyze(editTrack_track, editTrack_player))
     {   editTrack_bad = 1; 
         game_set_message_with_timeout("bad jump, need wait in loop.", MESSAGE_TIMEOUT);
     }
@@ -373,88 +363,13 @@ void editTrack_check()
     {   editTrack_bad = 0; 
         game_message[0] = 0;
     }
-    chip_kill();
-}
-
-int _editTrack_check()
-{   // check for a JUMP which loops back on itself without waiting at least a little bit.
-    // return 1 if so, 0 if not.
-    int j=0; // current command index
-    int j_last_jump = -1;
-    int found_wait = 0;
-    for (int k=0; k<64; ++k)
-    {   if (j >= MAX_TRACK_LENGTH) // got to the end
-            return 0;
-        if (j_last_jump >= 0)
-        {   if (j == j_last_jump) // we found our loop-back point
-                return !(found_wait); // did we find a wait?
-            int j_next_jump = -1;
-            switch (chip_track[editTrack_track][editTrack_player][j]&15)
-            {   case TrackJump:
-                    j_next_jump = 2*(chip_track[editTrack_track][editTrack_player][j]>>4);
-                    if (j_next_jump == j_last_jump) // jumping forward to the original jump
-                    {   message("jumped to the old jump\n");
-                        return !(found_wait);
-                    }
-                    else if (j_next_jump > j_last_jump) // jumping past original jump
-                    {   message("This probably shouldn't happen.\n");
-                        j_last_jump = -1; // can't look for loops...
-                    }
-                    else
-                    {   message("jumped backwards again?\n");
-                        j_last_jump = j;
-                        found_wait = 0;
-                    }
-                    j = j_next_jump;
-                    break;
-                case TrackWait:
-                case TrackArpNote:
-                    message("saw wait at j=%d\n", j);
-                    found_wait = 1;
-                    ++j;
-                    break;
-                case TrackBreak:
-                    // check for a randomizer behind
-                    if (j > 0 && (chip_track[editTrack_track][editTrack_player][j-1]&15) == TrackRandomize)
-                    {}
-                    else if ((chip_track[editTrack_track][editTrack_player][j]>>4) == 0)
-                        return 0;
-                    // fall through to ++j
-                default:
-                    ++j;
-            }
-        }
-        else switch (chip_track[editTrack_track][editTrack_player][j]&15)
-        {   case TrackJump:
-                j_last_jump = j;
-                j = 2*(chip_track[editTrack_track][editTrack_player][j]>>4);
-                if (j > j_last_jump)
-                {   message("This probably shouldn't happen??\n");
-                    j_last_jump = -1; // don't care, we moved ahead
-                }
-                else if (j == j_last_jump)
-                {   message("jumped to itself\n");
-                    return 1; // this is bad
-                }
-                else
-                    found_wait = 0;
-                break;
-            case TrackBreak:
-                // check for a randomizer behind
-                if (j > 0 && (chip_track[editTrack_track][editTrack_player][j-1]&15) == TrackRandomize)
-                {}
-                else if ((chip_track[editTrack_track][editTrack_player][j]>>4) == 0)
-                    return 0;
-                // fall through to ++j
-            default:
-                ++j;
-        }
-    }
-    message("couldn't finish after 32 iterations. congratulations.\nprobably looping back on self, but with waits.");
-    return 0;
+    // keep playing with the changes, unless they would get the players stuck:
+    if (editTrack_bad)
+        chip_kill();
+    else
+        chip_hot_patch();
 }
 
-
 void editTrack_adjust_parameter(int direction)
 {
     if (!direction)
@@ -468,6 +383,61 @@ void editTrack_adjust_parameter(int direction)
     editTrack_check();
 }
 
+void editTrack_frame()
+{   // Call every frame after the controls; works out which text rows need drawing again.
+    STATIC_ASSERT(NUMBER_LINES == TEXT_CACHE_ROWS);
+    const uint8_t *track = chip_track[editTrack_track][editTrack_player];
+    editTrack_show_end = MAX_TRACK_LENGTH;
+    for (int j = editTrack_offset; j < editTrack_offset + 16; ++j)
+    if (track[j] == TrackBreak && (j == 0 || (track[j-1]&15) != TrackRandomize))
+    {   editTrack_show_end = j + 1;
+        break;
+    }
+    // same as the track position indicator in editTrack_render_command:
+    int play_index = -1;
+    if (chip_playing == PlayingTrack)
+    {   play_index = chip_player[editTrack_player].track_cmd_index;
+        if (play_index)
+        switch (track[play_index-1]&15)
+        {   case TrackBreak:
+            case TrackWait:
+            case TrackArpNote:
+                --play_index;
+        }
+    }
+    // everything the text next to the commands depends on:
+    uint32_t status = TEXT_CACHE_SIGNATURE;
+    status = textCache_mix(status, editTrack_pos);
+    status = textCache_mix(status, track[editTrack_pos]);
+    status = textCache_mix(status, music_editor_in_menu);
+    status = textCache_mix(status, editTrack_menu_index);
+    status = textCache_mix(status, editTrack_copying < CHIP_PLAYERS * MAX_TRACKS);
+    status = textCache_mix(status, chip_playing);
+
+    for (int line = 0; line < NUMBER_LINES; ++line)
+    {   uint32_t signature = TEXT_CACHE_SIGNATURE;
+        if (line == 0)
+        {   signature = textCache_mix(signature, chip_playing && (track_pos/4 % 2==0));
+            signature = textCache_mix(signature, editTrack_track);
+            signature = textCache_mix(signature, editTrack_player);
+            signature = textCache_mix(signature, chip_player[editTrack_player].instrument);
+            signature = textCache_mix(signature, chip_track_playtime);
+        }
+        else if (line >= 2 && line < 18)
+        {   int j = editTrack_offset+line-2;
+            signature = textCache_mix(status, j);
+            signature = textCache_mix(signature, track[j]);
+            signature = textCache_mix(signature, j == editTrack_pos);
+            signature = textCache_mix(signature, j < editTrack_show_end);
+            signature = textCache_mix(signature, j == play_index);
+        }
+        else if (line == 18)
+        {   signature = textCache_mix(signature, GAMEPAD_HOLDING(0, select) != 0);
+        }
+        textCache_sign(line, signature);
+    }
+}
+
 // TODO: make sure to show all commands, even if they are past a break.
 // we can jump to those locations.  maybe make them gray.
 void editTrack_line()
@@ -476,7 +446,7 @@ void editTrack_line()
     {
         if (vga_line/2 == 0)
         {
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
             return;
         }
         return;
@@ -484,17 +454,22 @@ void editTrack_line()
     else if (vga_line >= 16 + NUMBER_LINES*10)
     {
         if (vga_line/2 == (16 +NUMBER_LINES*10)/2)
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     int line = (vga_line-16) / 10;
     int internal_line = (vga_line-16) % 10;
+    if (line == 1)
+    {   // the row under the title shows the sound being played
+        scope_line(internal_line, BYTE_PIXEL(BG_COLOR));
+        return;
+    }
     if (internal_line == 0 || internal_line == 9)
     {
-        memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+        memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         if (music_editor_in_menu && line == 0)
-        {   uint32_t *dst = (uint32_t *)draw_buffer + 39;
-            const uint32_t color = BOX_COLOR;
+        {   pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + 39;
+            const pixel_pair_t color = BOX_COLOR;
             switch (editTrack_menu_index)
             {   case EditTrackMenuTrackIndex:
                     dst += 4;
@@ -513,7 +488,13 @@ void editTrack_line()
         }
         return;
     }
+    if (line == 2 && internal_line == 1)
+    {   // the scope only got cleared out of the other line buffer:
+        memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
+    }
     --internal_line;
+    if (textCache_line(line, internal_line))
+        return;
     uint8_t buffer[24];
     switch (line)
     {
@@ -530,18 +511,17 @@ void editTrack_line()
                 ' ', 't', 'T', 'i', 'm', 'e', 
                 '=', '0' + chip_track_playtime/10, '0' + chip_track_playtime%10,
             0 };
-            font_render_line_doubled(msg, 16, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 16, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 1:
             break;
         case 2:
         {
-            editTrack_show_track = 1; 
             editTrack_render_command(editTrack_offset+line-2, internal_line);
             // command
             uint8_t msg[] = { 'c', 'o', 'm', 'm', 'a', 'n', 'd', ' ', hex_character[editTrack_pos], ':', 0 };
-            font_render_line_doubled(msg, 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(msg, 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         }
         case 3:
@@ -596,7 +576,7 @@ void editTrack_line()
                     strcpy((char *)buffer, "jump to cmd index");
                     break;
             }
-            font_render_line_doubled(buffer, 102, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled(buffer, 102, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 4:
         {   uint8_t command = chip_track[editTrack_track][editTrack_player][editTrack_pos];
@@ -607,7 +587,7 @@ void editTrack_line()
                     if (param == 7)
                     {   font_render_line_doubled
                         (   (const uint8_t *)"set from instrument",
-                            120, internal_line, 65535, BG_COLOR*257
+                            120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)
                         );
                     }
                     break;
@@ -631,7 +611,7 @@ void editTrack_line()
                             break;
                     }
                     if (msg[0])
-                        font_render_line_doubled((const uint8_t *)msg, 120, internal_line, 65535, BG_COLOR*257);
+                        font_render_line_doubled((const uint8_t *)msg, 120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                     break;
                 }
                 case TrackArpScale:
@@ -688,7 +668,7 @@ void editTrack_line()
                         default:
                             msg = "??";
                     }
-                    font_render_line_doubled((const uint8_t *)msg, 120, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((const uint8_t *)msg, 120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                     break;
                 }
                 case TrackVibrato:
@@ -710,41 +690,41 @@ void editTrack_line()
                     }
                     msg[8] = hex_character[param % 4];
                     msg[9] = 0;
-                    font_render_line_doubled(msg, 120, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled(msg, 120, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                     break;
                 }
             }
             goto maybe_show_track;
         }
         case 5:
-            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257); 
+            font_render_line_doubled((uint8_t *)"switch to:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR)); 
             goto maybe_show_track;
         case 6:
             if (music_editor_in_menu)
             {
-                font_render_line_doubled((uint8_t *)"L:prev track", 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"L:prev track", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 buffer[0] = 'L'; buffer[1] = ':';
                 editTrack_short_command_message(buffer+2, chip_track[editTrack_track][editTrack_player][editTrack_pos]-1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_track;
         case 7:
             if (music_editor_in_menu)
             {
-                font_render_line_doubled((uint8_t *)"R:next track", 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"R:next track", 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
                 buffer[0] = 'R'; buffer[1] = ':';
                 editTrack_short_command_message(buffer+2, chip_track[editTrack_track][editTrack_player][editTrack_pos]+1);
-                font_render_line_doubled(buffer, 112, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled(buffer, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_track;
         case 8:
-            font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"dpad:", 102 - 6*music_editor_in_menu, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 9:
         {   const char *msg = "";
@@ -765,71 +745,72 @@ void editTrack_line()
             }
             else
                 msg = "adjust parameters";
-            font_render_line_doubled((const uint8_t *)msg, 112, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)msg, 112, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         }
         case 11:
             if (music_editor_in_menu)
             {   if (editTrack_copying < CHIP_PLAYERS * MAX_TRACKS)
-                    font_render_line_doubled((uint8_t *)"A:cancel copy", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"A:cancel copy", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
                 else
-                    font_render_line_doubled((uint8_t *)"A:save to file", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"A:save to file", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else if (chip_playing)
-                font_render_line_doubled((uint8_t *)"A/B:stop playing", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"A/B:stop playing", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             else
-                font_render_line_doubled((uint8_t *)"A:play track", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"A:play track", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 12:
             if (music_editor_in_menu)
             {   if (editTrack_copying < CHIP_PLAYERS * MAX_TRACKS)
-                    font_render_line_doubled((uint8_t *)"B/X:\"     \"", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"B/X:\"     \"", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
 
                 else
-                    font_render_line_doubled((uint8_t *)"B:load from file", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"B:load from file", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else if (!chip_playing)
-                font_render_line_doubled((uint8_t *)"B:play track from here", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"B:play track from here", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 13:
             if (music_editor_in_menu)
             {
                 if (editTrack_copying < CHIP_PLAYERS * MAX_TRACKS)
-                    font_render_line_doubled((uint8_t *)"Y:paste", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"Y:paste", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
 
                 else
-                    font_render_line_doubled((uint8_t *)"X:copy", 96, internal_line, 65535, BG_COLOR*257);
+                    font_render_line_doubled((uint8_t *)"X:copy", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             else
             {
-                font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"X:cut cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             }
             goto maybe_show_track;
         case 14:
             if (!music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"Y:insert cmd", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 16:
             if (music_editor_in_menu)
-                font_render_line_doubled((uint8_t *)"start:edit track", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:edit track", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             else
-                font_render_line_doubled((uint8_t *)"start:track menu", 96, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"start:track menu", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 17:
-            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, 65535, BG_COLOR*257);
+            font_render_line_doubled((uint8_t *)"select:special", 96, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             goto maybe_show_track;
         case 18:
             if (GAMEPAD_HOLDING(0, select))
-                font_render_line_doubled((uint8_t *)"> inst < song ^ up", 100, internal_line, 65535, BG_COLOR*257);
+                font_render_line_doubled((uint8_t *)"> inst < song ^ up", 100, internal_line, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 19:
             break;
         default:
           maybe_show_track:
-            if (editTrack_show_track)
+            if (editTrack_offset+line-2 < editTrack_show_end)
                 editTrack_render_command(editTrack_offset+line-2, internal_line);
             break; 
     }
+    textCache_capture(line, internal_line, BYTE_PIXEL(BG_COLOR));
 }
 
 void editTrack_controls()
@@ -884,6 +865,7 @@ void editTrack_controls()
                     editTrack_player = (editTrack_player+switched)&3;
                     break;
                 case EditTrackMenuTrackLength:
+                    chip_render_ahead_flush();
                     chip_track_playtime += switched * 4;
                     if (chip_track_playtime > 64)
                         chip_track_playtime = 64;
@@ -936,6 +918,7 @@ void editTrack_controls()
                     return;
                 }
                 memcpy(dst, src, sizeof(chip_track[0][0]));
+                chip_track_analyze(editTrack_track, editTrack_player);
                 game_set_message_with_timeout("pasted.", MESSAGE_TIMEOUT);
                 editTrack_copying = CHIP_PLAYERS * MAX_TRACKS;
             }
@@ -1063,6 +1046,7 @@ void editTrack_controls()
 
         if (GAMEPAD_PRESS(0, A))
         {   // play track from beginning (or stop playing)
+            chip_render_ahead_flush();
             track_pos = 0;
             if (chip_playing)
             {   message("stop play\n");
@@ -9,6 +9,7 @@ extern uint8_t editTrack_player;
 void editTrack_init();
 void editTrack_load_defaults();
 void editTrack_controls();
+void editTrack_frame();
 void editTrack_line();
 
 #endif
@@ -1,5 +1,6 @@
 #include "bitbox.h"
 #include "chip.h"
+#include "cycles.h"
 #include "debug-sprite.h"
 #include "edit-instrument.h"
 #include "edit-song.h"
@@ -8,6 +9,11 @@
 #include "game.h"
 #include "io.h"
 #include "name.h"
+#include "profile.h"
+#include "scope.h"
+#include "sprite.h"
+#include "task.h"
+#include "text-cache.h"
 
 uint16_t new_gamepad[2] CCM_MEMORY;
 uint16_t old_gamepad[2] CCM_MEMORY;
@@ -19,16 +25,29 @@ game_mode_t previous_game_mode CCM_MEMORY;
 uint8_t game_message[32] CCM_MEMORY;
 int game_message_timeout CCM_MEMORY;
 
+// cycles for background tasks at the end of each frame, and in each line
+// (whole odd lines, and whatever is left of even lines after drawing):
+#define GAME_FRAME_TASK_CYCLES (24*CYCLES_PER_LINE)
+#define GAME_LINE_TASK_CYCLES (CYCLES_PER_LINE*3/4)
+
+static task_result_t game_render_ahead_step()
+{   // gets some sound ready, in the time left over from drawing.
+    return chip_render_ahead_work(CHIP_RENDER_AHEAD_CHUNK) ? TaskMore : TaskIdle;
+}
+
 void game_init()
 {   // Logic run once when setting up the Bitbox; Bitbox will call this, don't do it yourself.
 #ifdef EMULATOR 
     test_chip();
     test_physics();
+    test_sprite();
 #endif
 
     game_mode = ModeNone;
     previous_game_mode = ModeNone;
 
+    cycles_init();
+    task_start(&task_line, game_render_ahead_step);
     chip_init();
     font_init();
     editTrack_init();
@@ -47,9 +66,22 @@ void game_init()
 
 void game_frame()
 {   // Logic to run every frame; Bitbox will call this, don't do it yourself.
+    uint32_t start = cycles_now();
     new_gamepad[0] |= gamepad_buttons[0] & (~old_gamepad[0]);
     new_gamepad[1] |= gamepad_buttons[1] & (~old_gamepad[1]);
 
+    #if PROFILE_ENABLED
+    if (GAMEPAD_PRESS(1, select))
+    {   // the text cache may have captured the overlay, so redraw everything:
+        profile_overlay = !profile_overlay;
+        textCache_reset();
+    }
+    if (GAMEPAD_PRESS(1, start))
+    {   profile_report();
+        profile_reset();
+    }
+    #endif
+
     switch (game_mode)
     {   // Run frame logic depending on game mode.
         case ModeNameSong:
@@ -70,6 +102,24 @@ void game_frame()
         default:
             break;
     }
+    switch (game_mode)
+    {   // The editors check which of their text rows changed, after the controls (which may switch modes):
+        case ModeEditSong:
+            editSong_frame();
+            break;
+        case ModeEditTrack:
+            editTrack_frame();
+            break;
+        case ModeEditInstrument:
+            editInstrument_frame();
+            break;
+        default:
+            break;
+    }
+    // the scope shows up in the instrument and track editors:
+    scope_frame(game_mode == ModeEditInstrument || game_mode == ModeEditTrack);
+    // the sprites for this frame are prepared (e.g. by debugSprite_controls), show them from vga_line 0 on:
+    sprite_commit();
     
     old_gamepad[0] = gamepad_buttons[0];
     old_gamepad[1] = gamepad_buttons[1];
@@ -81,25 +131,41 @@ void game_frame()
     
     if (game_message_timeout && --game_message_timeout == 0)
         game_message[0] = 0; 
+
+    // slow work (e.g. saving) a piece at a time, before the chip gets going again:
+    task_run(&task_frame, cycles_now() + GAME_FRAME_TASK_CYCLES);
+
+    // any changes to the chip state are done for this frame:
+    chip_render_ahead_resume();
+    profile_frame(start);
 }
 
 static void bsod_line();
 
+static void game_line();
+
 void graph_line()
 {   // Logic to draw for each line on the VGA display; Bitbox will call this, don't do it yourself.
+    uint32_t start = cycles_now();
+    if (!vga_odd)
+    {   game_line();
+        profile_line(start);
+    }
+    // nothing gets drawn on odd lines, so use the time to get some sound ready
+    // (and whatever time drawing left over on even lines):
+    task_run(&task_line, start + GAME_LINE_TASK_CYCLES);
+}
 
-    // TODO: consider doing some non-drawing work on odd frames:
-    if (vga_odd)
-        return;
-
+static void game_line()
+{   // Draws the line, depending on game mode.
     if (game_message[0])
     {   // Drawing the game message takes priority, nothing else can show up where that message goes:
         unsigned int delta_y = vga_line - 220;
         if (delta_y < 10)
-        {   memset(draw_buffer, 0, 2*SCREEN_W);
+        {   memset(draw_buffer, 0, sizeof(pixel_t)*SCREEN_W);
             --delta_y;
             if (delta_y < 8)
-            {   font_render_line_doubled(game_message, 36, (int)delta_y, 65535, 0);
+            {   font_render_line_doubled(game_message, 36, (int)delta_y, BYTE_PIXEL(255), 0);
             }
             // Don't allow any other drawing in this region...
             return;
@@ -129,6 +195,10 @@ void graph_line()
     }
 }
 
+static inline int game_mode_is_music_editor(game_mode_t mode)
+{   return mode == ModeEditInstrument || mode == ModeEditSong || mode == ModeEditTrack;
+}
+
 void game_switch(game_mode_t new_game_mode)
 {   // Switches to a new game mode.  Does nothing if already in that mode.
     if (new_game_mode == game_mode)
@@ -136,10 +206,14 @@ void game_switch(game_mode_t new_game_mode)
     // don't let things trigger again if possible
     gamepad_press_wait[0] = GAMEPAD_PRESS_WAIT;
 
-    chip_kill();
+    // keep the music going while switching between the music editors:
+    if (!game_mode_is_music_editor(game_mode) || !game_mode_is_music_editor(new_game_mode))
+        chip_kill();
 
     previous_game_mode = game_mode;
     game_mode = new_game_mode;
+    // the editors' text rows all need drawing again:
+    textCache_reset();
 
     switch (game_mode)
     {   // Run start-up logic depending on game mode.
@@ -189,24 +263,21 @@ static void bsod_line()
     int internal_line = vga_line%10;
     if (vga_line/2 == 0 || (internal_line/2 == 4))
     {   // Make the beautiful blue background we deserve:
-        memset(draw_buffer, BSOD_COLOR8, 2*SCREEN_W);
+        memset(draw_buffer, BSOD_COLOR8, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     line -= 4;
     if (line < 0 || line >= 16)
         return;
-    uint32_t *dst = (uint32_t *)draw_buffer + 37;
-    // TODO: just shift
-    uint32_t color_choice[2] = { (BSOD_COLOR8*257)|((BSOD_COLOR8*257)<<16), 65535|(65535<<16) };
+    pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + 37;
+    const pixel_pair_t color_choice[2] = { BYTE_PIXEL_PAIR(BSOD_COLOR8), BYTE_PIXEL_PAIR(255) };
+    font_wide_t wide[4];
+    font_wide_colors(wide, color_choice);
     int shift = ((internal_line/2))*4;
     for (int c=0; c<16; ++c)
     {   // Draw all the letters in the font for fun
-        uint8_t row = (font[c+line*16] >> shift) & 15;
-        for (int j=0; j<4; ++j)
-        {   // Draw each pixel in the letter
-            *(++dst) = color_choice[row&1];
-            row >>= 1;
-        }
+        font_render_wide_row(dst + 1, font[c+line*16] >> shift, wide);
+        dst += 4;
         *(++dst) = color_choice[0];
     }
 }
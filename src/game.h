@@ -7,6 +7,24 @@
 #define SCREEN_W 320
 #define SCREEN_H 240
 
+// draw_buffer holds 16-bit pixels, or 8-bit pixels when built with VGA_BPP=8 (see RGB in bitbox.h),
+// which halves what every line costs to write.  Most drawing goes two pixels at a time, with a
+// pixel_pair_t holding the left pixel in its low bits.
+#ifndef VGA_BPP
+#define VGA_BPP 16
+#endif
+#if VGA_BPP == 8
+typedef uint8_t pixel_t;
+typedef uint16_t pixel_pair_t;
+#else
+typedef uint16_t pixel_t;
+typedef uint32_t pixel_pair_t;
+#endif
+#define PIXEL_PAIR(left, right) ((pixel_pair_t)((pixel_pair_t)(left) | ((pixel_pair_t)(right) << VGA_BPP)))
+// a color given as a byte, like memset(draw_buffer, byte, ...) gives it, for one pixel or a pair:
+#define BYTE_PIXEL(byte) ((pixel_t)(257u*(byte)))
+#define BYTE_PIXEL_PAIR(byte) ((pixel_pair_t)(16843009u*(byte)))
+
 #ifdef EMULATOR
 #define EMU_ONLY(x) x
 #else
@@ -88,6 +106,7 @@ void game_set_message_with_timeout(const char *msg, int timeout);
     new_element->next_name = next; \
     new_element->previous_name = 0; \
     container[next].previous_name = index; \
+    container[0].next_name = index; \
     \
     return index;
 
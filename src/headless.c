@@ -0,0 +1,246 @@
+// A stand-in for the Bitbox kernel, for running the game on the host without the
+// emulator window (build it with `make headless`).  Every frame runs game_frame(),
+// then graph_line() for both halves of all 240 lines, like the kernel does, and
+// times each graph_line() call.
+//
+// usage: headless [-n frames] [-i script] [-o prefix] [-e every] [-t timing.csv] [-b budget]
+//   -n  number of frames to run (default 600)
+//   -i  input script, one line per change of the buttons held: a frame number and the
+//       buttons held from that frame on, e.g. "60 start", "90 select up" or "120";
+//       buttons on the second gamepad start with "2:", e.g. "150 2:select"
+//   -o  write frames as PPM images, named prefix00000.ppm and so on
+//   -e  only write every so many frames (default 1)
+//   -t  write how long every graph_line() took, as frame,line,even_ns,odd_ns
+//   -b  budget for one graph_line() call in nanoseconds (default one VGA line);
+//       the exit status is 1 if any call went over it
+// Nothing is on the SD card, so saving and loading always fail.
+#include "bitbox.h"
+#include "game.h"
+
+#include <stdio.h>
+#include <stdlib.h> // strtol
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#define HEADLESS_VGA_LINES_PER_SECOND 31469
+
+// the kernel's side of bitbox.h, with the same types as declared there:
+__typeof__(vga_line) vga_line;
+__typeof__(vga_frame) vga_frame;
+__typeof__(vga_odd) vga_odd;
+__typeof__(draw_buffer) draw_buffer;
+__typeof__(gamepad_buttons) gamepad_buttons;
+
+static pixel_t headless_line_buffer[2][1024] __attribute__((aligned(4)));
+static uint16_t headless_sound[BITBOX_SNDBUF_LEN];
+static uint8_t headless_image[SCREEN_H][SCREEN_W][3];
+
+void message(const char *fmt, ...)
+{   va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void bitbox_die(int led, int sound)
+{   fprintf(stderr, "died in frame %d, line %d (%d, %d)\n", (int)vga_frame, (int)vga_line, led, sound);
+    exit(2);
+}
+
+// FatFs without a card: everything fails with FR_NOT_READY.  ff.h isn't included
+// so these don't depend on which version of it io.c gets built with.
+#define HEADLESS_FR_NOT_READY 3
+int f_mount() { return HEADLESS_FR_NOT_READY; }
+int f_open() { return HEADLESS_FR_NOT_READY; }
+int f_close() { return HEADLESS_FR_NOT_READY; }
+int f_read() { return HEADLESS_FR_NOT_READY; }
+int f_write() { return HEADLESS_FR_NOT_READY; }
+int f_lseek() { return HEADLESS_FR_NOT_READY; }
+
+static const struct
+{   const char *name;
+    uint16_t button;
+} headless_button_names[] =
+{   {"A", gamepad_A}, {"B", gamepad_B}, {"X", gamepad_X}, {"Y", gamepad_Y},
+    {"L", gamepad_L}, {"R", gamepad_R}, {"select", gamepad_select}, {"start", gamepad_start},
+    {"up", gamepad_up}, {"down", gamepad_down}, {"left", gamepad_left}, {"right", gamepad_right},
+};
+
+static int headless_script_next(FILE *script, int *frame, uint16_t buttons[2])
+{   // reads the next change of buttons from the script, returns 0 at its end.
+    char line[256];
+    while (fgets(line, sizeof(line), script))
+    {   char *word = strtok(line, " \t\r\n");
+        if (!word || word[0] == '#')
+            continue;
+        *frame = strtol(word, NULL, 10);
+        buttons[0] = 0;
+        buttons[1] = 0;
+        while ((word = strtok(NULL, " \t\r\n")))
+        {   int pad = strncmp(word, "2:", 2) == 0;
+            int found = 0;
+            for (size_t i = 0; i < sizeof(headless_button_names)/sizeof(headless_button_names[0]); ++i)
+            if (strcmp(word + 2*pad, headless_button_names[i].name) == 0)
+            {   buttons[pad] |= headless_button_names[i].button;
+                found = 1;
+            }
+            if (!found)
+                fprintf(stderr, "unknown button \"%s\" for frame %d\n", word, *frame);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static uint32_t headless_ns()
+{   struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec*1000000000u + (uint32_t)now.tv_nsec;
+}
+
+static int headless_write_image(const char *prefix, int frame)
+{   // writes headless_image as a binary PPM, returns 0 if that failed.
+    char filename[1024];
+    snprintf(filename, sizeof(filename), "%s%05d.ppm", prefix, frame);
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+        return 0;
+    fprintf(file, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+    int ok = fwrite(headless_image, sizeof(headless_image), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+static void headless_capture_line()
+{   // converts draw_buffer (0RRRRRGGGGGBBBBB, or RRRGGBBB for VGA_BPP=8) into vga_line of headless_image.
+    for (int x = 0; x < SCREEN_W; ++x)
+    {   pixel_t color = draw_buffer[x];
+        #if VGA_BPP == 8
+        headless_image[vga_line][x][0] = (color >> 5) * 255 / 7;
+        headless_image[vga_line][x][1] = ((color >> 3) & 3) * 255 / 3;
+        headless_image[vga_line][x][2] = (color & 7) * 255 / 7;
+        #else
+        headless_image[vga_line][x][0] = ((color >> 10) & 31) * 255 / 31;
+        headless_image[vga_line][x][1] = ((color >> 5) & 31) * 255 / 31;
+        headless_image[vga_line][x][2] = (color & 31) * 255 / 31;
+        #endif
+    }
+}
+
+int main(int argc, char **argv)
+{   int frames = 600;
+    const char *prefix = NULL;
+    int every = 1;
+    FILE *script = NULL;
+    FILE *timing = NULL;
+    uint32_t budget = 1000000000u / HEADLESS_VGA_LINES_PER_SECOND;
+    for (int i = 1; i < argc; ++i)
+    {   if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 || i + 1 == argc)
+        {   fprintf(stderr, "usage: %s [-n frames] [-i script] [-o prefix] [-e every] [-t timing.csv] [-b budget]\n", argv[0]);
+            return 2;
+        }
+        const char *value = argv[++i];
+        switch (argv[i-1][1])
+        {   case 'n':
+                frames = strtol(value, NULL, 10);
+                break;
+            case 'i':
+                if (!(script = fopen(value, "r")))
+                {   perror(value);
+                    return 2;
+                }
+                break;
+            case 'o':
+                prefix = value;
+                break;
+            case 'e':
+                every = strtol(value, NULL, 10);
+                if (every < 1)
+                    every = 1;
+                break;
+            case 't':
+                if (!(timing = fopen(value, "w")))
+                {   perror(value);
+                    return 2;
+                }
+                fprintf(timing, "frame,line,even_ns,odd_ns\n");
+                break;
+            case 'b':
+                budget = strtol(value, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "unknown option %s\n", argv[i-1]);
+                return 2;
+        }
+    }
+
+    int change_frame = -1;
+    uint16_t change_buttons[2] = {0, 0};
+    if (script && !headless_script_next(script, &change_frame, change_buttons))
+        change_frame = -1;
+
+    uint32_t worst[2] = {0, 0}; // for even and odd calls
+    int worst_frame[2] = {0, 0}, worst_line[2] = {0, 0};
+    uint64_t total[2] = {0, 0};
+    int over_budget = 0;
+
+    draw_buffer = headless_line_buffer[0];
+    game_init();
+    for (int frame = 0; frame < frames; ++frame)
+    {   while (change_frame >= 0 && change_frame <= frame)
+        {   gamepad_buttons[0] = change_buttons[0];
+            gamepad_buttons[1] = change_buttons[1];
+            if (!headless_script_next(script, &change_frame, change_buttons))
+                change_frame = -1;
+        }
+
+        // the kernel runs the frame logic and fills the sound buffer during vertical blank:
+        game_frame();
+        game_snd_buffer(headless_sound, BITBOX_SNDBUF_LEN);
+
+        for (vga_line = 0; vga_line < SCREEN_H; ++vga_line)
+        {   draw_buffer = headless_line_buffer[vga_line & 1];
+            uint32_t ns[2];
+            for (int odd = 0; odd < 2; ++odd)
+            {   vga_odd = odd;
+                uint32_t start = headless_ns();
+                graph_line();
+                ns[odd] = headless_ns() - start;
+                total[odd] += ns[odd];
+                if (ns[odd] > worst[odd])
+                {   worst[odd] = ns[odd];
+                    worst_frame[odd] = frame;
+                    worst_line[odd] = vga_line;
+                }
+                if (ns[odd] > budget)
+                    ++over_budget;
+                if (!odd)
+                    headless_capture_line();
+            }
+            if (timing)
+                fprintf(timing, "%d,%d,%u,%u\n", frame, (int)vga_line, ns[0], ns[1]);
+        }
+        ++vga_frame;
+
+        if (prefix && frame % every == 0 && !headless_write_image(prefix, frame))
+        {   perror(prefix);
+            return 2;
+        }
+    }
+
+    if (timing)
+        fclose(timing);
+    if (script)
+        fclose(script);
+    for (int odd = 0; odd < 2; ++odd)
+        fprintf
+        (   stderr, "%s lines: %.0f ns average, %u ns worst (frame %d, line %d)\n",
+            odd ? "odd" : "even", frames ? (double)total[odd] / ((uint64_t)frames*SCREEN_H) : 0.0,
+            worst[odd], worst_frame[odd], worst_line[odd]
+        );
+    if (over_budget)
+    {   fprintf(stderr, "%d graph_line() calls went over %u ns\n", over_budget, budget);
+        return 1;
+    }
+    return 0;
+}
@@ -242,7 +242,9 @@ io_error_t io_load_recent_song_filename()
         {
             base_song_filename[i] = 0;
             if (++i < bytes_get)
+            {   chip_render_ahead_flush();
                 chip_volume = buffer[i];
+            }
             message(">> got volume %d and recent song filename: \"%s\"\n", chip_volume, base_song_filename);
             return IoNoError;
         }
@@ -281,6 +283,7 @@ static io_error_t _io_load_INSTRUMENTS(unsigned int i)
     chip_instrument[i].is_drum = read&15;
     chip_instrument[i].octave = read >> 4;
     fat_result = f_read(&fat_file, &chip_instrument[i].cmd[0], MAX_INSTRUMENT_LENGTH, &bytes_get);
+    chip_instrument_analyze(i);
     if (fat_result != FR_OK)
         return IoReadError;
     if (bytes_get != MAX_INSTRUMENT_LENGTH)
@@ -322,6 +325,8 @@ io_error_t _io_load_TRACKS(unsigned int i)
     message(">> loading track %d\n", i);
     UINT bytes_get; 
     fat_result = f_read(&fat_file, chip_track[i], TRACKS_BYTE_STRIDE, &bytes_get);
+    for (int p=0; p<CHIP_PLAYERS; ++p)
+        chip_track_analyze(i, p);
     if (fat_result != FR_OK)
         return IoReadError;
     if (bytes_get != TRACKS_BYTE_STRIDE)
@@ -350,6 +355,29 @@ io_error_t io_save_track(unsigned int i)
     SAVE_INDEXED(TRACKS, i, MAX_TRACKS);
 }
 
+static io_error_t _io_load_SONG()
+{   // Loads the song commands, from wherever fat_file is.
+    UINT bytes_get; 
+    fat_result = f_read(&fat_file, &chip_song_cmd[0], SONG_BYTE_LENGTH, &bytes_get);
+    chip_song_analyze();
+    if (fat_result != FR_OK)
+        return IoReadError;
+    if (bytes_get != SONG_BYTE_LENGTH)
+        return IoMissingDataError;
+    return IoNoError;
+}
+
+static io_error_t _io_save_SONG()
+{   // Saves the song commands, to wherever fat_file is.
+    UINT bytes_get; 
+    fat_result = f_write(&fat_file, &chip_song_cmd[0], SONG_BYTE_LENGTH, &bytes_get);
+    if (fat_result != FR_OK)
+        return IoWriteError;
+    if (bytes_get != SONG_BYTE_LENGTH)
+        return IoMissingDataError;
+    return IoNoError;
+}
+
 io_error_t io_load_song()
 {   // Loads the song.
     io_error_t ferr = io_save_recent_song_filename();
@@ -361,22 +389,9 @@ io_error_t io_load_song()
         return IoOpenError;
     
     f_lseek(&fat_file, SONG_BYTE_OFFSET);
-
-    UINT bytes_get; 
-    fat_result = f_read(&fat_file, &chip_song_cmd[0], SONG_BYTE_LENGTH, &bytes_get);
-    if (fat_result != FR_OK)
-    {   f_close(&fat_file);
-        return IoReadError;
-    }
-    if (bytes_get != SONG_BYTE_LENGTH)
-    {   f_close(&fat_file);
-        return IoMissingDataError;
-    }
-
-    // TODO: maybe check validity (i.e., a wait somewhere)
-
+    ferr = _io_load_SONG();
     f_close(&fat_file);
-    return IoNoError;
+    return ferr;
 }
 
 io_error_t io_save_song()
@@ -391,18 +406,231 @@ io_error_t io_save_song()
         return ferr;
     
     f_lseek(&fat_file, SONG_BYTE_OFFSET);
+    ferr = _io_save_SONG();
+    f_close(&fat_file);
+    return ferr;
+}
 
-    UINT bytes_get; 
-    fat_result = f_write(&fat_file, &chip_song_cmd[0], SONG_BYTE_LENGTH, &bytes_get);
-    if (fat_result != FR_OK)
-    {   f_close(&fat_file);
-        return IoWriteError;
+// Saving or loading everything in the file a piece at a time, in file order:
+// the instruments, then the tracks, then the song.
+#define IO_ALL_PIECES (16 + MAX_TRACKS + 1)
+
+io_event_t io_all_event;
+static uint8_t io_all_piece; // the next piece to save or load
+
+io_error_t io_all_start(io_event_t save_or_load)
+{   // Opens the file for saving or loading everything with io_all_continue().
+    if (io_all_event)
+        return IoConstraintError;
+    io_error_t ferr = io_save_recent_song_filename();
+    if (ferr)
+        return ferr;
+    if (save_or_load == IoEventSave)
+    {   ferr = io_open_or_zero_file(full_song_filename, TOTAL_FILE_SIZE);
+        if (ferr)
+            return ferr;
     }
-    if (bytes_get != SONG_BYTE_LENGTH)
+    else if (save_or_load == IoEventLoad)
+    {   fat_result = f_open(&fat_file, (char *)full_song_filename, FA_READ | FA_OPEN_EXISTING); 
+        if (fat_result != FR_OK)
+            return IoOpenError;
+    }
+    else
+        return IoConstraintError;
+    STATIC_ASSERT(INSTRUMENTS_BYTE_OFFSET + 16*INSTRUMENTS_BYTE_STRIDE == TRACKS_BYTE_OFFSET);
+    STATIC_ASSERT(TRACKS_BYTE_OFFSET + MAX_TRACKS*TRACKS_BYTE_STRIDE == SONG_BYTE_OFFSET);
+    f_lseek(&fat_file, INSTRUMENTS_BYTE_OFFSET);
+    message("opening %s to %s everything\n", full_song_filename, save_or_load == IoEventSave ? "save" : "load");
+    io_all_event = save_or_load;
+    io_all_piece = 0;
+    return IoNoError;
+}
+
+io_error_t io_all_continue()
+{   // Saves or loads the next piece, closing the file after the last one (or an error).
+    // io_all_event goes back to IoEventNone once that happens.
+    if (!io_all_event)
+        return IoNoError;
+    int save = io_all_event == IoEventSave;
+    int piece = io_all_piece++;
+    io_error_t ferr;
+    if (piece < 16)
+        ferr = save ? _io_save_INSTRUMENTS(piece) : _io_load_INSTRUMENTS(piece);
+    else if ((piece -= 16) < MAX_TRACKS)
+        ferr = save ? _io_save_TRACKS(piece) : _io_load_TRACKS(piece);
+    else
+        ferr = save ? _io_save_SONG() : _io_load_SONG();
+    if (ferr || io_all_piece == IO_ALL_PIECES)
     {   f_close(&fat_file);
+        io_all_event = IoEventNone;
+    }
+    return ferr;
+}
+
+const char *io_all_piece_name()
+{   // what io_all_continue() last worked on, as a prefix for an error message.
+    if (io_all_piece <= 16)
+        return "instr. ";
+    if (io_all_piece <= 16 + MAX_TRACKS)
+        return "track ";
+    return "song ";
+}
+
+// Exporting the song as a WAV file, a few sound buffers per frame.
+// The samples are 8-bit stereo, which is exactly what the chip generates,
+// and the header is padded to a full sector so that the samples stay sector-aligned.
+#define EXPORT_HEADER_BYTES 512
+#define EXPORT_MAX_SECONDS (10*60)
+#define EXPORT_BUFFERS_PER_FRAME 4
+
+uint8_t io_exporting;
+static FIL export_file;
+static uint16_t export_buffer[CHIP_RENDER_AHEAD_LEN];
+static uint32_t export_bytes; // of samples written so far
+static uint32_t export_start_frame;
+static uint8_t export_saved_limit;
+
+static void io_export_put32(uint8_t *dst, uint32_t value)
+{   // Writes value little-endian.
+    dst[0] = value;
+    dst[1] = value >> 8;
+    dst[2] = value >> 16;
+    dst[3] = value >> 24;
+}
+
+static io_error_t io_export_write_header()
+{   // Writes (or rewrites) the header at the start of the file, using export_bytes for the sizes.
+    uint8_t *header = (uint8_t *)export_buffer;
+    STATIC_ASSERT(sizeof(export_buffer) >= EXPORT_HEADER_BYTES);
+    memset(header, 0, EXPORT_HEADER_BYTES);
+    memcpy(header, "RIFF", 4);
+    io_export_put32(header + 4, EXPORT_HEADER_BYTES - 8 + export_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    io_export_put32(header + 16, 16);
+    io_export_put32(header + 20, 1 /* PCM */ | (2 /* channels */ << 16));
+    io_export_put32(header + 24, BITBOX_SNDRATE);
+    io_export_put32(header + 28, 2*BITBOX_SNDRATE); // bytes per second
+    io_export_put32(header + 32, 2 /* bytes per sample */ | (8 /* bits per channel */ << 16));
+    // padding chunk, which players skip:
+    memcpy(header + 36, "JUNK", 4);
+    io_export_put32(header + 40, EXPORT_HEADER_BYTES - 44 - 8);
+    memcpy(header + EXPORT_HEADER_BYTES - 8, "data", 4);
+    io_export_put32(header + EXPORT_HEADER_BYTES - 4, export_bytes);
+
+    f_lseek(&export_file, 0);
+    UINT bytes_get;
+    fat_result = f_write(&export_file, header, EXPORT_HEADER_BYTES, &bytes_get);
+    if (fat_result != FR_OK)
+        return IoWriteError;
+    if (bytes_get != EXPORT_HEADER_BYTES)
         return IoMissingDataError;
+    return IoNoError;
+}
+
+static void io_export_stop()
+{   // Goes back to playing sound normally.
+    chip_kill();
+    chip_sound_off = 0;
+    #if CHIP_RENDER_AHEAD_SLOTS
+    chip_render_ahead_limit = export_saved_limit;
+    #endif
+    io_exporting = 0;
+}
+
+io_error_t io_export_song_start()
+{   // Starts exporting the song (from the beginning) to a WAV file named after the song.
+    // Call io_export_song_continue() every frame until io_exporting is 0 again.
+    if (io_exporting)
+        return IoNoError;
+    int filename_len = strlen((char *)base_song_filename);
+    if (filename_len == 0)
+        return IoConstraintError;
+    if (io_mounted == 0 && io_init())
+        return IoMountError;
+
+    uint8_t filename[13];
+    memcpy(filename, base_song_filename, filename_len);
+    strcpy((char *)filename + filename_len, ".WAV");
+    fat_result = f_open(&export_file, (char *)filename, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fat_result != FR_OK)
+        return IoOpenError;
+    export_bytes = 0;
+    io_error_t error = io_export_write_header();
+    if (error)
+    {   f_close(&export_file);
+        return error;
     }
 
-    f_close(&fat_file);
+    message(">> exporting song to %s\n", filename);
+    io_exporting = 1;
+    export_start_frame = vga_frame;
+    chip_play_song(0);
+    chip_sound_off = 1;
+    #if CHIP_RENDER_AHEAD_SLOTS
+    // render as far ahead as possible, nobody is listening:
+    export_saved_limit = chip_render_ahead_limit;
+    chip_render_ahead_limit = CHIP_RENDER_AHEAD_SLOTS;
+    #endif
     return IoNoError;
 }
+
+io_error_t io_export_song_continue()
+{   // Writes out the sound buffers that got rendered since the last frame, finishing
+    // up the file once the song ends (or gets too long).  While this writes to the card,
+    // the next buffers are rendered in the idle time of graph_line (see game_render_ahead_step).
+    if (!io_exporting)
+        return IoNoError;
+    uint8_t song_loops;
+    for (int k=0; k<EXPORT_BUFFERS_PER_FRAME && chip_render_ahead_take(export_buffer, &song_loops); ++k)
+    {   if (song_loops || export_bytes >= 2*BITBOX_SNDRATE*EXPORT_MAX_SECONDS)
+        {   // the song came back to the start, so we're done:
+            io_error_t error = io_export_write_header();
+            f_close(&export_file);
+            io_export_stop();
+            if (error)
+                return error;
+            uint32_t frames = vga_frame - export_start_frame;
+            if (!frames)
+                frames = 1;
+            // throughput, in tenths of real time and in KB/s:
+            uint32_t speed = export_bytes * 60 * 10 / (2*BITBOX_SNDRATE * frames);
+            uint32_t kbps = export_bytes * 60 / 1024 / frames;
+            message(">> exported %d bytes in %d frames\n", (int)export_bytes, (int)frames);
+            strcpy((char *)game_message, "wav saved, ");
+            uint8_t *msg = game_message + 11;
+            if (speed >= 100)
+                *msg++ = '0' + speed/100 % 10;
+            *msg++ = '0' + speed/10 % 10;
+            *msg++ = '.';
+            *msg++ = '0' + speed % 10;
+            strcpy((char *)msg, "x ");
+            msg += 2;
+            if (kbps >= 100)
+                *msg++ = '0' + kbps/100 % 10;
+            if (kbps >= 10)
+                *msg++ = '0' + kbps/10 % 10;
+            *msg++ = '0' + kbps % 10;
+            strcpy((char *)msg, "KB/s");
+            game_message_timeout = 0;
+            return IoNoError;
+        }
+        UINT bytes_get;
+        fat_result = f_write(&export_file, export_buffer, sizeof(export_buffer), &bytes_get);
+        if (fat_result != FR_OK || bytes_get != sizeof(export_buffer))
+        {   f_close(&export_file);
+            io_export_stop();
+            return fat_result != FR_OK ? IoWriteError : IoMissingDataError;
+        }
+        export_bytes += sizeof(export_buffer);
+    }
+    return IoNoError;
+}
+
+void io_export_song_cancel()
+{   // Stops exporting, keeping what was written so far as a valid (but shorter) file.
+    if (!io_exporting)
+        return;
+    io_export_write_header();
+    f_close(&export_file);
+    io_export_stop();
+}
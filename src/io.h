@@ -36,4 +36,17 @@ io_error_t io_load_track(unsigned int i);
 io_error_t io_save_song();
 io_error_t io_load_song();
 
+// Saving or loading the whole song file (song, tracks and instruments) a piece at a time:
+// after io_all_start(), call io_all_continue() until io_all_event is IoEventNone again.
+extern io_event_t io_all_event;
+io_error_t io_all_start(io_event_t save_or_load);
+io_error_t io_all_continue();
+const char *io_all_piece_name();
+
+// nonzero while the song is being exported to a WAV file:
+extern uint8_t io_exporting;
+io_error_t io_export_song_start();
+io_error_t io_export_song_continue();
+void io_export_song_cancel();
+
 #endif
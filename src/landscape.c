@@ -0,0 +1,117 @@
+#include "bitbox.h"
+#include "game.h"
+#include "landscape.h"
+#include "physics.h"
+#include "sprite.h"
+
+#include <math.h>
+
+int16_t landscape_camera_x CCM_MEMORY;
+int16_t landscape_camera_y CCM_MEMORY;
+uint16_t landscape_depth_map[LANDSCAPE_ROWS][LANDSCAPE_COLUMNS] CCM_MEMORY;
+
+// what landscape_depth_map was built from, to find out what changed since:
+static int16_t landscape_built_x CCM_MEMORY;
+static int16_t landscape_built_y CCM_MEMORY;
+static uint8_t landscape_built_count CCM_MEMORY;
+static physics_boundary_t landscape_built[MAX_PHYSICS_STATICS] CCM_MEMORY;
+
+static void landscape_project(const physics_boundary_t *box, int *x0, int *x1, int *y0, int *y1)
+{   // screen rectangle (in pixels) that the box shows up in.
+    *x0 = (int)floorf(box->corner_min[0]) - landscape_camera_x;
+    *x1 = (int)ceilf(box->corner_max[0]) - landscape_camera_x;
+    *y0 = (int)floorf(box->corner_min[1] - box->corner_max[2]) - landscape_camera_y;
+    *y1 = (int)ceilf(box->corner_max[1] - box->corner_min[2]) - landscape_camera_y;
+}
+
+static inline int landscape_cell_floor(int pixel, int max_cell)
+{   return pixel <= 0 ? 0 : pixel >= max_cell*LANDSCAPE_CELL ? max_cell : pixel / LANDSCAPE_CELL;
+}
+
+static inline int landscape_cell_ceil(int pixel, int max_cell)
+{   return landscape_cell_floor(pixel + LANDSCAPE_CELL - 1, max_cell);
+}
+
+static void landscape_build(int c0, int c1, int r0, int r1)
+{   // recomputes the cells in columns c0 up to c1 and rows r0 up to r1 from all the static boxes.
+    for (int r = r0; r < r1; ++r)
+    for (int c = c0; c < c1; ++c)
+        landscape_depth_map[r][c] = 0;
+
+    for (int ps = 0; ps < physics_static.count; ++ps)
+    {   const physics_boundary_t *box = &physics_static.entity[ps].boundary;
+        int x0, x1, y0, y1;
+        landscape_project(box, &x0, &x1, &y0, &y1);
+        int box_c0 = landscape_cell_floor(x0, LANDSCAPE_COLUMNS);
+        int box_c1 = landscape_cell_ceil(x1, LANDSCAPE_COLUMNS);
+        int box_r0 = landscape_cell_floor(y0, LANDSCAPE_ROWS);
+        int box_r1 = landscape_cell_ceil(y1, LANDSCAPE_ROWS);
+        if (box_c0 < c0) box_c0 = c0;
+        if (box_c1 > c1) box_c1 = c1;
+        if (box_r0 < r0) box_r0 = r0;
+        if (box_r1 > r1) box_r1 = r1;
+        // screen y where the front face of the box starts:
+        float front = box->corner_max[1] - box->corner_max[2] - landscape_camera_y;
+        for (int r = box_r0; r < box_r1; ++r)
+        {   // cells touching the front face are as near as the front;
+            // otherwise use the furthest point of the top face in the cell,
+            // so that sprites standing on top don't get hidden.
+            float y = box->corner_max[1];
+            if ((r + 1) * LANDSCAPE_CELL <= front)
+            {   y = r * LANDSCAPE_CELL + landscape_camera_y + box->corner_max[2];
+                if (y < box->corner_min[1])
+                    y = box->corner_min[1];
+            }
+            uint16_t depth = sprite_depth(y);
+            for (int c = box_c0; c < box_c1; ++c)
+            if (landscape_depth_map[r][c] < depth)
+                landscape_depth_map[r][c] = depth;
+        }
+    }
+}
+
+void landscape_reset()
+{   // builds the depth map from scratch.
+    STATIC_ASSERT(LANDSCAPE_COLUMNS*LANDSCAPE_CELL == SCREEN_W && LANDSCAPE_ROWS*LANDSCAPE_CELL == SCREEN_H);
+    landscape_build(0, LANDSCAPE_COLUMNS, 0, LANDSCAPE_ROWS);
+    landscape_built_x = landscape_camera_x;
+    landscape_built_y = landscape_camera_y;
+    landscape_built_count = physics_static.count;
+    for (int ps = 0; ps < physics_static.count; ++ps)
+        landscape_built[ps] = physics_static.entity[ps].boundary;
+}
+
+void landscape_frame()
+{   // call once a frame after moving the camera or static boxes, before sprite_frame().
+    // only the cells where a static box was (or now is) get rebuilt, unless the camera moved.
+    if
+    (   landscape_camera_x != landscape_built_x || landscape_camera_y != landscape_built_y ||
+        physics_static.count != landscape_built_count
+    )
+    {   landscape_reset();
+        return;
+    }
+
+    int c0 = LANDSCAPE_COLUMNS, c1 = 0, r0 = LANDSCAPE_ROWS, r1 = 0;
+    for (int ps = 0; ps < physics_static.count; ++ps)
+    {   const physics_boundary_t *box = &physics_static.entity[ps].boundary;
+        if (!memcmp(box, &landscape_built[ps], sizeof(*box)))
+            continue;
+        for (int which = 0; which < 2; ++which)
+        {   // grow the region to rebuild by the old and new place of the box:
+            int x0, x1, y0, y1;
+            landscape_project(which ? box : &landscape_built[ps], &x0, &x1, &y0, &y1);
+            int cell = landscape_cell_floor(x0, LANDSCAPE_COLUMNS);
+            if (cell < c0) c0 = cell;
+            cell = landscape_cell_ceil(x1, LANDSCAPE_COLUMNS);
+            if (cell > c1) c1 = cell;
+            cell = landscape_cell_floor(y0, LANDSCAPE_ROWS);
+            if (cell < r0) r0 = cell;
+            cell = landscape_cell_ceil(y1, LANDSCAPE_ROWS);
+            if (cell > r1) r1 = cell;
+        }
+        landscape_built[ps] = *box;
+    }
+    if (c0 < c1 && r0 < r1)
+        landscape_build(c0, c1, r0, r1);
+}
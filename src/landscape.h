@@ -0,0 +1,25 @@
+#ifndef LANDSCAPE_H
+#define LANDSCAPE_H
+
+#include <stdint.h>
+
+// A coarse depth map of the static world (physics_static) as seen on screen,
+// so sprites can be hidden behind terrain with one lookup per 16 pixel column.
+//
+// World coordinates (x, y, z) have z up, and get seen from above at an angle:
+//   screen x = x - landscape_camera_x
+//   screen y = y - z - landscape_camera_y
+// Things further down the screen in y are nearer, i.e. have a larger sprite iz.
+// Depths are in the world (see sprite_depth()), so they don't change when the camera moves.
+#define LANDSCAPE_CELL 16
+#define LANDSCAPE_COLUMNS 20 // SCREEN_W/LANDSCAPE_CELL
+#define LANDSCAPE_ROWS 15 // SCREEN_H/LANDSCAPE_CELL
+
+extern int16_t landscape_camera_x, landscape_camera_y;
+// sprite iz of the nearest terrain in each cell of the screen, or 0 for none:
+extern uint16_t landscape_depth_map[LANDSCAPE_ROWS][LANDSCAPE_COLUMNS];
+
+void landscape_reset();
+void landscape_frame();
+
+#endif
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# Generates src/bitmaps.c and src/bitmaps.h, run-length encoded 4-bit bitmaps for sprites.
+# Each pixel is a hex digit indexing into sprite_palette, or '.' for transparent.
+# A bitmap can also be the path of a paletted PNG in src/ (e.g. "src/knight.png", so the Makefile
+# picks up changes to it); palette indices 0-15 are used as is, fully transparent ones become '.'.
+# Every row becomes a list of (skip, run, color) spans: skip transparent pixels
+# (counting from the end of the previous span), then draw run pixels of color.
+import struct
+import zlib
+
+bitmaps = [
+   ("Bitmap_Knight", [
+    "....2222....",
+    "...2eeee2...",
+    "...2e22e2...",
+    "...2eeee2...",
+    "....2ee2....",
+    "..11111111..",
+    ".1111111111.",
+    ".11.1111.11.",
+    ".33.1111.33.",
+    ".33.1111.33.",
+    "....1111....",
+    "....11.11...",
+    "....11.11...",
+    "....66.66...",
+    "...666.666..",
+    "............"]),
+   ("Bitmap_Tree", [
+    "......aaaa......",
+    "....aaaaaaaa....",
+    "...aaa9aaaaaa...",
+    "..aaaaaaa9aaaa..",
+    ".aa9aaaaaaaaaaa.",
+    ".aaaaaa9aaaa9aa.",
+    "aaaaaaaaaaaaaaaa",
+    "aaa9aaaaaaa9aaaa",
+    ".aaaaa9aaaaaaaa.",
+    ".aaaaaaaaa9aaaa.",
+    "..aaaaaaaaaaaa..",
+    "...aaaa66aaaa...",
+    ".......66.......",
+    ".......66.......",
+    ".......76.......",
+    "......7766......",
+    ".....777666.....",
+    "................"]),
+   ("Bitmap_Chest", [
+    "..666666666666..",
+    ".65555555555556.",
+    "6555555555555556",
+    "6666666886666666",
+    "6555555885555556",
+    "6555555555555556",
+    "6555555555555556",
+    "6666666666666666"]),
+]
+
+def png_rows(path):
+    # reads a non-interlaced paletted PNG into rows of hex digits and dots, like the art above.
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise Exception('%s is not a PNG'%path)
+    position = 8
+    idat = b''
+    transparent = set()
+    while position < len(data):
+        length, kind = struct.unpack('>I4s', data[position:position + 8])
+        chunk = data[position + 8:position + 8 + length]
+        position += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, color_type, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+            if color_type != 3 or interlace:
+                raise Exception('%s needs to be a non-interlaced paletted PNG'%path)
+        elif kind == b'tRNS':
+            transparent = set(i for i, alpha in enumerate(chunk) if alpha == 0)
+        elif kind == b'IDAT':
+            idat += chunk
+        elif kind == b'IEND':
+            break
+    raw = zlib.decompress(idat)
+    stride = (width*depth + 7)//8
+    rows = []
+    previous = bytearray(stride)
+    for y in range(height):
+        start = y*(stride + 1)
+        kind = raw[start]
+        line = bytearray(raw[start + 1:start + 1 + stride])
+        # undo the filter, where a pixel is never more than one byte for paletted images:
+        for x in range(stride):
+            left = line[x - 1] if x else 0
+            up = previous[x]
+            up_left = previous[x - 1] if x else 0
+            if kind == 1:
+                line[x] = (line[x] + left) & 255
+            elif kind == 2:
+                line[x] = (line[x] + up) & 255
+            elif kind == 3:
+                line[x] = (line[x] + (left + up)//2) & 255
+            elif kind == 4:
+                estimate = left + up - up_left
+                a, b, c = abs(estimate - left), abs(estimate - up), abs(estimate - up_left)
+                line[x] = (line[x] + (left if a <= b and a <= c else up if b <= c else up_left)) & 255
+        previous = line
+        row = ''
+        for x in range(width):
+            bit = x*depth
+            index = (line[bit//8] >> (8 - depth - bit%8)) & ((1 << depth) - 1)
+            if index in transparent:
+                row += '.'
+            elif index < 16:
+                row += '%x'%index
+            else:
+                raise Exception('%s uses palette index %d, sprite_palette only has 16'%(path, index))
+        rows.append(row)
+    return rows
+
+def row_spans(row):
+    # turns a row of hex digits and dots into (skip, run, color) spans.
+    spans = []
+    skip = 0
+    x = 0
+    while x < len(row):
+        if row[x] == '.':
+            skip += 1
+            x += 1
+            continue
+        color = int(row[x], 16)
+        run = 1
+        while x + run < len(row) and row[x + run] == row[x]:
+            run += 1
+        spans.append((skip, run, color))
+        skip = 0
+        x += run
+    return spans
+
+spans = []
+rows = []
+headers = []
+for b, (name, pixels) in enumerate(bitmaps):
+    if isinstance(pixels, str):
+        pixels = png_rows(pixels)
+        bitmaps[b] = (name, pixels)
+    width = len(pixels[0])
+    for row in pixels:
+        if len(row) != width:
+            raise Exception('%s has rows of different widths'%name)
+    if width > 255 or len(pixels) > 255:
+        raise Exception('%s is too big'%name)
+    headers.append((name, width, len(pixels), len(rows)))
+    for row in pixels:
+        rows.append(len(spans))
+        spans.extend(row_spans(row))
+rows.append(len(spans))
+if len(spans) > 65535:
+    raise Exception('too many spans')
+
+with open("src/bitmaps.c", 'w') as f:
+    f.write("//AUTOGENERATED BY mk_bitmaps.py\n\n")
+    f.write('#include "bitmaps.h"\n\n')
+    f.write("const uint8_t bitmap_spans[][3] = {\n")
+    for span in spans:
+        f.write("  {%d, %d, %d},\n"%span)
+    f.write("};\n\n")
+    f.write("const uint16_t bitmap_rows[] = {\n")
+    for row in rows:
+        f.write("  %d,\n"%row)
+    f.write("};\n\n")
+    f.write("const bitmap_t bitmap[BITMAP_COUNT] = {\n")
+    for name, width, height, first_row in headers:
+        f.write("  {%d, %d, %d}, // %s\n"%(width, height, first_row, name))
+    f.write("};\n")
+
+with open("src/bitmaps.h", 'w') as f:
+    f.write("//AUTOGENERATED BY mk_bitmaps.py\n\n")
+    f.write("#ifndef BITMAPS_H\n#define BITMAPS_H\n#include <stdint.h>\n")
+    f.write('#include "shapes.h"\n\n')
+    f.write("typedef enum\n{   // bitmap sprite shapes, numbered after the flat shapes.\n")
+    f.write("    %s = ShapeCount,\n"%bitmaps[0][0])
+    for name, pixels in bitmaps[1:]:
+        f.write("    %s,\n"%name)
+    f.write("    // DO NOT USE PAST THIS POINT\n    BitmapEnd,\n} sprite_bitmap_t;\n\n")
+    f.write("#define BITMAP_COUNT (BitmapEnd - ShapeCount)\n\n")
+    f.write("typedef struct bitmap\n{   uint8_t width, height;\n    uint16_t first_row; // into bitmap_rows\n} bitmap_t;\n\n")
+    f.write("// (skip, run, color) for each span, see mk_bitmaps.py:\n")
+    f.write("extern const uint8_t bitmap_spans[][3];\n")
+    f.write("// spans of row r of bitmap b are bitmap_rows[bitmap[b].first_row + r] up to the next row's start:\n")
+    f.write("extern const uint16_t bitmap_rows[];\n")
+    f.write("extern const bitmap_t bitmap[BITMAP_COUNT];\n")
+    f.write("#endif\n")
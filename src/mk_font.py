@@ -1029,16 +1029,26 @@ characters = [
     "****"],
 ]
 
+def doubled(x):
+    # every pixel of every row of a glyph twice over, 8 bits per row, rows starting at bits 0, 8, 16, 24.
+    result = 0
+    for power in range(16):
+        if x & (1<<power):
+            result |= 3<<(2*power)
+    return result
+
 with open("src/font.c", 'w') as f:
     f.write("//AUTOGENERATED BY mk_font.py\n\n")
     f.write('#include "bitbox.h"\n#include "font.h"\n#include "game.h"\n#include <string.h>\n')
     f.write("uint16_t font[256] CCM_MEMORY;\n")
+    f.write("uint32_t font_doubled[256] CCM_MEMORY;\n")
     f.write("uint16_t font_cache[256] = {\n")
     if starting_index:
         f.write("[%d]="%starting_index)
     else:
         f.write("  ")
     char_map = {}
+    glyphs = [0]*256
     for i in range(len(characters)):
         char = characters[i]
         x = 0
@@ -1051,6 +1061,7 @@ with open("src/font.c", 'w') as f:
         if x != 0 and x in char_map and i < 224: # randoms can redo earlier things
             raise Exception('character at %d already in map at %d'%(i, char_map[x]))
         char_map[x] = i
+        glyphs[starting_index + i] = x
         if i + 1 == len(characters):
             f.write("%d\n"%x)
         else:
@@ -1058,15 +1069,20 @@ with open("src/font.c", 'w') as f:
     f.write("};\n")
     if len(characters) + starting_index > 256:
         print("WARNING, overflow!")
+    f.write("const uint32_t font_doubled_cache[256] = {\n")
+    for i in range(0, 256, 8):
+        f.write("  %s,\n"%", ".join("0x%08x"%doubled(x) for x in glyphs[i:i+8]))
+    f.write("};\n")
     f.write("""
 void font_init()
 {   // Initializes the font cache.  make sure to call in game_init()
     memcpy(font, font_cache, sizeof(font_cache));
+    memcpy(font_doubled, font_doubled_cache, sizeof(font_doubled_cache));
 }
 /* //TODO: 
-void font_render_character(uint8_t character, int x, int delta_y, uint16_t color_fg, uint16_t color_bg)
+void font_render_character(uint8_t character, int x, int delta_y, pixel_t color_fg, pixel_t color_bg)
 */
-void font_render_line_doubled(const uint8_t *text, int x, int delta_y, uint16_t color_fg, uint16_t color_bg)
+void font_render_line_doubled(const uint8_t *text, int x, int delta_y, pixel_t color_fg, pixel_t color_bg)
 {   // Renders a line of font that is 2x the font size, with foreground and background color
     // Top-left of text begins at position at (x, vga_line - delta_y) onscreen.
     #ifdef EMULATOR
@@ -1088,26 +1104,40 @@ void font_render_line_doubled(const uint8_t *text, int x, int delta_y, uint16_t
         return;
     }
     #endif
-    delta_y = ((delta_y/2))*4; // make delta_y now how much to shift
-    uint16_t *dst = draw_buffer + x;
-    uint16_t color_choice[2] = { color_bg, color_fg };
-    *dst = color_choice[0];
+    delta_y = ((delta_y/2))*8; // make delta_y now how much to shift font_doubled
+    // both pixels for each two bits of a doubled glyph row:
+    const pixel_pair_t pair[4] =
+    {   PIXEL_PAIR(color_bg, color_bg), PIXEL_PAIR(color_fg, color_bg),
+        PIXEL_PAIR(color_bg, color_fg), PIXEL_PAIR(color_fg, color_fg)
+    };
+    pixel_t *dst = draw_buffer + x;
+    // every character is 8 pixels of glyph and then a pixel of background;
+    // pending is 1 if a background pixel still needs to go before the next glyph:
+    int pending = 1;
+    if (x & 1)
+    {   // get to an even pixel so the rest can be written two at a time:
+        *dst++ = color_bg;
+        pending = 0;
+    }
+    pixel_pair_t *dst2 = (pixel_pair_t *)dst;
     --text;
     int c;
     while ((c = *(++text)))
     {
-        uint8_t row = (font[c] >> delta_y) & 15;
-        for (int j=0; j<4; ++j)
-        {
-            *(++dst) = color_choice[row&1];
-            *(++dst) = color_choice[row&1];
-            row >>= 1;
-        }
-        *(++dst) = color_choice[0];
+        uint32_t bits = ((font_doubled[c] >> delta_y) & 255) << pending;
+        *dst2++ = pair[bits & 3];
+        *dst2++ = pair[(bits >> 2) & 3];
+        *dst2++ = pair[(bits >> 4) & 3];
+        *dst2++ = pair[(bits >> 6) & 3];
+        if (pending)
+            *dst2++ = pair[bits >> 8];
+        pending = !pending;
     }
+    if (pending)
+        *(pixel_t *)dst2 = color_bg;
 }
 
-void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, uint16_t color_fg)
+void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, pixel_t color_fg)
 {   // Renders a line of font that is 2x the font size, with foreground color only; background color is transparent.
     // Ensure enough contrast on the screen with the existing background color(s), please!
     // Top-left of text begins at position at (x, vga_line - delta_y) onscreen.
@@ -1131,7 +1161,7 @@ void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, uin
     }
     #endif
     delta_y = ((delta_y/2))*4; // make delta_y now how much to shift
-    uint16_t *dst = draw_buffer + x;
+    pixel_t *dst = draw_buffer + x;
     --text;
     int c;
     while ((c = *(++text)))
@@ -1159,7 +1189,29 @@ void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, uin
 
 with open("src/font.h", 'w') as f:
     f.write("//AUTOGENERATED BY mk_font.py\n\n")
-    f.write("#ifndef FONT_H\n#define FONT_H\n#include <stdint.h>\n")
-    f.write("extern uint16_t font_cache[256];\nextern uint16_t font[256];\nvoid font_init();\nvoid font_render_line_doubled(const uint8_t *text, int x, int delta_y, uint16_t color_fg, uint16_t color_bg);\n")
-    f.write("void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, uint16_t color_fg);\n");
+    f.write('#ifndef FONT_H\n#define FONT_H\n#include "game.h" // pixel_t\n#include <stdint.h>\n#include <string.h> // memcpy\n')
+    f.write("extern uint16_t font_cache[256];\nextern uint16_t font[256];\n")
+    f.write("// every pixel of a glyph row doubled, 8 bits per row, rows starting at bits 0, 8, 16, 24:\n")
+    f.write("extern const uint32_t font_doubled_cache[256];\nextern uint32_t font_doubled[256];\n")
+    f.write("void font_init();\nvoid font_render_line_doubled(const uint8_t *text, int x, int delta_y, pixel_t color_fg, pixel_t color_bg);\n")
+    f.write("void font_render_no_bg_line_doubled(const uint8_t *text, int x, int delta_y, pixel_t color_fg);\n");
+    f.write("""
+// For glyphs drawn with a pixel_pair_t per glyph pixel, given color_choice[2] for 0 and 1 bits,
+// wide[i] are the pairs for the two glyph pixels with bits i:
+#if VGA_BPP == 8
+typedef uint32_t font_wide_t;
+#else
+typedef uint64_t font_wide_t;
+#endif
+static inline void font_wide_colors(font_wide_t wide[4], const pixel_pair_t color_choice[2])
+{   for (int i = 0; i < 4; ++i)
+        wide[i] = color_choice[i & 1] | ((font_wide_t)color_choice[i >> 1] << 2*VGA_BPP);
+}
+
+static inline void font_render_wide_row(pixel_pair_t *dst, unsigned row, const font_wide_t wide[4])
+{   // writes the 4 pairs of a glyph row (the low 4 bits of row, e.g. from font[c] >> shift), two at a time.
+    memcpy(dst, &wide[row & 3], sizeof(font_wide_t));
+    memcpy(dst + 2, &wide[(row >> 2) & 3], sizeof(font_wide_t));
+}
+""")
     f.write("#endif\n")
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Generates src/shapes.c and src/shapes.h, the per-row span tables for sprite shapes.
+# Every row of a shape is described by six offsets [x0, x1, x2, x3, x4, x5]:
+#   pixels x0 up to x1 get color1, x2 up to x3 get color2, and x4 up to x5 get color1 again,
+# with nothing drawn in between, so a row can be at most three runs in that order.
+# Offsets are in units of the size class, so they need scaling by width/size when drawing.
+
+import itertools
+import math
+
+size_classes = [8, 16, 32, 64] # rows (and columns) in the table for each size class
+
+def ellipse(u, v):
+    # true if (u, v) in [0, 1)^2 is inside the ellipse filling the unit square.
+    return (2*u - 1)**2 + (2*v - 1)**2 < 1
+
+def ellipse_inner(u, v, border):
+    # true if inside the ellipse shrunk by border on each side.
+    r = 0.5 - border
+    return r > 0 and ((u - 0.5)/r)**2 + ((v - 0.5)/r)**2 < 1
+
+def shield_half_width(v):
+    # straight sides at the top, tapering to a point at the bottom.
+    if v < 0.5:
+        return 0.5
+    return 0.5*math.sqrt(max(0, 1 - ((v - 0.5)*2)**2))
+
+def shield(u, v):
+    return abs(u - 0.5) < shield_half_width(v)
+
+def shield_inner(u, v, border):
+    return v > border and v < 1 - border and abs(u - 0.5) < shield_half_width(v) - border
+
+def segment_distance(u, v, angle, t0, t1):
+    # distance from (u, v) to the segment from the center, running from t0 to t1 along angle.
+    du, dv = math.cos(angle), -math.sin(angle)
+    t = (u - 0.5)*du + (v - 0.5)*dv
+    t = min(max(t, t0), t1)
+    return math.hypot(u - 0.5 - t*du, v - 0.5 - t*dv)
+
+def sword(angle):
+    # sword held at the center of the sprite, pointing along angle.
+    def classify(u, v, size):
+        thickness = max(0.04, 0.6/size)
+        if segment_distance(u, v, angle, -0.1, 0.12) < max(0.09, 0.8/size):
+            return 2 # hand and hilt
+        if segment_distance(u, v, angle, 0.12, 0.48) < thickness:
+            return 1 # blade
+        return 0
+    return classify
+
+def border_for(size):
+    return max(1.0/8, 1.0/size)
+
+# shape with coloring information after the underscore.
+# each classifier returns 0 for no pixel, 1 for color1, or 2 for color2 at (u, v) in [0, 1)^2.
+shapes = [
+    ("NoShape_Invisible", lambda u, v, size: 0),
+    ("Rectangle_TopHalfBottomHalf", lambda u, v, size: 1 if v < 0.5 else 2),
+    ("Rectangle_LeftRight", lambda u, v, size: 1 if u < 0.5 else 2),
+    ("Ellipse_TopHalfBottomHalf", lambda u, v, size: 0 if not ellipse(u, v) else 1 if v < 0.5 else 2),
+    ("Ellipse_LeftRight", lambda u, v, size: 0 if not ellipse(u, v) else 1 if u < 0.5 else 2),
+    ("Ellipse_DiagonalForwardSlash", lambda u, v, size: 0 if not ellipse(u, v) else 1 if u + v < 1 else 2),
+    ("Ellipse_DiagonalBackSlash", lambda u, v, size: 0 if not ellipse(u, v) else 1 if u < v else 2),
+    # E.g. for round shields:
+    ("Ellipse_ThickBorder", lambda u, v, size:
+        0 if not ellipse(u, v) else 2 if ellipse_inner(u, v, border_for(size)) else 1),
+    ("Shield_ThickBorder", lambda u, v, size:
+        0 if not shield(u, v) else 2 if shield_inner(u, v, border_for(size)) else 1),
+]
+for i in range(16):
+    shapes.append(("SwordProfileAngle%X_HandAndHilt"%i, sword(i*math.pi/8)))
+
+def row_spans(name, classify, size, row):
+    # turns one row of pixels into [x0, x1, x2, x3, x4, x5], one span per run of pixels.
+    v = (row + 0.5)/size
+    pixels = [classify((column + 0.5)/size, v, size) for column in range(size)]
+    runs = []
+    x = 0
+    for color, group in itertools.groupby(pixels):
+        length = len(list(group))
+        if color:
+            runs.append((color, x, x + length))
+        x += length
+    # fit the runs into the color1, color2, color1 spans in order, leaving the others empty:
+    spans = [[0, 0], [0, 0], [0, 0]]
+    slot = 0
+    for color, x0, x1 in runs:
+        while slot < 3 and color != (2 if slot == 1 else 1):
+            spans[slot] = [x0, x0]
+            slot += 1
+        if slot == 3:
+            raise Exception('%s has a row with runs %s at size %d, row %d'%(name,
+                ''.join(str(color) for color, x0, x1 in runs), size, row))
+        spans[slot] = [x0, x1]
+        slot += 1
+    end = spans[slot - 1][1] if slot else 0
+    for empty in range(slot, 3):
+        spans[empty] = [end, end]
+    return spans[0] + spans[1] + spans[2]
+
+total_rows = sum(size_classes)
+with open("src/shapes.c", 'w') as f:
+    f.write("//AUTOGENERATED BY mk_shapes.py\n\n")
+    f.write('#include "shapes.h"\n\n')
+    f.write("const uint8_t shape_spans[ShapeCount][SHAPE_ROWS][6] = {\n")
+    for name, classify in shapes:
+        f.write("  { // %s\n"%name)
+        for size in size_classes:
+            f.write("    // %d rows\n"%size)
+            for row in range(size):
+                f.write("    {%d, %d, %d, %d, %d, %d},\n"%tuple(row_spans(name, classify, size, row)))
+        f.write("  },\n")
+    f.write("};\n")
+
+with open("src/shapes.h", 'w') as f:
+    f.write("//AUTOGENERATED BY mk_shapes.py\n\n")
+    f.write("#ifndef SHAPES_H\n#define SHAPES_H\n#include <stdint.h>\n\n")
+    f.write("typedef enum\n{   // shape with coloring information after the underscore.\n")
+    for name, classify in shapes:
+        f.write("    %s,\n"%name)
+    f.write("    // DO NOT USE PAST THIS POINT\n    ShapeCount,\n} sprite_shape_t;\n\n")
+    f.write("#define SHAPE_SIZE_CLASSES %d\n"%len(size_classes))
+    f.write("#define SHAPE_MIN_SIZE_SHIFT %d // size class c has (%d << c) rows\n"%(
+        int(math.log2(size_classes[0])), size_classes[0]))
+    f.write("#define SHAPE_ROW_OFFSET(c) ((%d << (c)) - %d) // first row of size class c\n"%(
+        size_classes[0], size_classes[0]))
+    f.write("#define SHAPE_ROWS %d\n"%total_rows)
+    f.write("// per shape, per size class, per row: [x0, x1) and [x4, x5) get color1, [x2, x3) gets color2.\n")
+    f.write("extern const uint8_t shape_spans[ShapeCount][SHAPE_ROWS][6];\n")
+    f.write("#endif\n")
@@ -52,27 +52,27 @@ void name_line()
     if (vga_line < 22)
     {   // Show a blank strip across the top:
         if (vga_line/2 == 0)
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     if (vga_line >= 22 + NUMBER_ROWS*10)
     {   // Draw a blank line across the bottom of the page:
         if (vga_line/2 == (22 + NUMBER_ROWS*10)/2)
-            memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+            memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         return;
     }
     int row = (vga_line-22) / 10;
     int delta_y = (vga_line-22) % 10;
     if (delta_y >= 8)
     {
-        memset(draw_buffer, BG_COLOR, 2*SCREEN_W);
+        memset(draw_buffer, BG_COLOR, sizeof(pixel_t)*SCREEN_W);
         if (delta_y % 2) return;
         // also check for character selector
         if (row == 0)
         {
             // spot in the filename to write to
-            uint16_t *dst = draw_buffer + TEXT_OFFSET + 1 + name_position * 9;
-            const uint16_t color = BOX_COLOR;
+            pixel_t *dst = draw_buffer + TEXT_OFFSET + 1 + name_position * 9;
+            const pixel_t color = BOX_COLOR;
             *dst++ = color;
             *dst++ = color;
             *dst++ = color;
@@ -84,8 +84,8 @@ void name_line()
         }
         else if (name_y+1 == row)
         {
-            uint16_t *dst = draw_buffer + 1 + name_x * 9 + OFFSET_X;
-            const uint16_t color = BOX_COLOR;
+            pixel_t *dst = draw_buffer + 1 + name_x * 9 + OFFSET_X;
+            const pixel_t color = BOX_COLOR;
             *dst++ = color;
             *dst++ = color;
             *dst++ = color;
@@ -97,8 +97,8 @@ void name_line()
         }
         else if (row == 6 && delta_y == 8)
         {
-            uint16_t *dst = draw_buffer + 1 + name_x * 9 + OFFSET_X;
-            const uint16_t color = MATRIX_WING_COLOR;
+            pixel_t *dst = draw_buffer + 1 + name_x * 9 + OFFSET_X;
+            const pixel_t color = MATRIX_WING_COLOR;
             *dst++ = color;
             *dst++ = color;
             *dst++ = color;
@@ -111,44 +111,44 @@ void name_line()
     }
     else switch (row)
     {   case 0:
-            font_render_line_doubled((const uint8_t *)"name:", 16, delta_y, 65535, BG_COLOR*257);
-            font_render_line_doubled(name_to_modify, TEXT_OFFSET, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)"name:", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
+            font_render_line_doubled(name_to_modify, TEXT_OFFSET, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 7:
-            font_render_line_doubled((const uint8_t *)"A:insert Y:overwrite", 16, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)"A:insert Y:overwrite", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 8:
-            font_render_line_doubled((const uint8_t *)"B:backspace X:delete", 16, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)"B:backspace X:delete", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 9:
-            font_render_line_doubled((const uint8_t *)"<L/R>:move cursor", 16, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)"<L/R>:move cursor", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 11:
-            font_render_line_doubled((const uint8_t *)"start:finish", 16, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)"start:finish", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         case 12:
             if (GAMEPAD_HOLDING(0, select))
-                font_render_line_doubled((const uint8_t *)"select+\x7f:debug", 16, delta_y, 65535, BG_COLOR*257);
+                font_render_line_doubled((const uint8_t *)"select+\x7f:debug", 16, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
             break;
         default:
             if (row > 6)
                 break;
-            font_render_line_doubled((const uint8_t *)allowed_chars[row-1], OFFSET_X, delta_y, 65535, BG_COLOR*257);
+            font_render_line_doubled((const uint8_t *)allowed_chars[row-1], OFFSET_X, delta_y, BYTE_PIXEL(255), BYTE_PIXEL(BG_COLOR));
 
             if (row-1 != name_y)
                 break;
             if (name_x < 5)
             {
                 {
-                uint16_t *dst = draw_buffer + (name_x * 9 + OFFSET_X);
-                const uint16_t color = BOX_COLOR;
+                pixel_t *dst = draw_buffer + (name_x * 9 + OFFSET_X);
+                const pixel_t color = BOX_COLOR;
                 *dst = color;
                 dst += 9;
                 *dst = color;
                 }
                 {
-                uint32_t *dst = (uint32_t *)draw_buffer + (1 + 6 * 9 + OFFSET_X)/2;
-                const uint32_t color = MATRIX_WING_COLOR | ((BG_COLOR*257)<<16);
+                pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + (1 + 6 * 9 + OFFSET_X)/2;
+                const pixel_pair_t color = PIXEL_PAIR(MATRIX_WING_COLOR, BYTE_PIXEL(BG_COLOR));
                 *dst++ = color;
                 *dst++ = color;
                 *dst++ = color;
@@ -159,13 +159,13 @@ void name_line()
             else
             {
                 {
-                uint16_t *dst = draw_buffer + (name_x * 9 + OFFSET_X);
-                const uint16_t color = BOX_COLOR;
+                pixel_t *dst = draw_buffer + (name_x * 9 + OFFSET_X);
+                const pixel_t color = BOX_COLOR;
                 *dst = color;
                 }
                 {
-                uint32_t *dst = (uint32_t *)draw_buffer + (1 + 6 * 9 + OFFSET_X)/2;
-                const uint32_t color = BOX_COLOR | ((BG_COLOR*257)<<16);
+                pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + (1 + 6 * 9 + OFFSET_X)/2;
+                const pixel_pair_t color = PIXEL_PAIR(BOX_COLOR, BYTE_PIXEL(BG_COLOR));
                 *dst++ = color;
                 *dst++ = color;
                 *dst++ = color;
@@ -98,9 +98,16 @@ void physics_reset()
     LL_RESET(physics_object, next_object, previous_object, MAX_PHYSICS_OBJECTS);
 }
 
+static uint8_t physics_allocate_object()
+{   LL_NEW(physics_object, next_object, previous_object, MAX_PHYSICS_OBJECTS);
+}
+
 uint8_t physics_new_object()
 {   // returns an index to a free physics_object, or zero if none.
-    LL_NEW(physics_object, next_object, previous_object, MAX_PHYSICS_OBJECTS);
+    uint8_t index = physics_allocate_object();
+    if (index)
+        physics_object[index].sprite = 0;
+    return index;
 }
 
 void physics_free_object(uint8_t index)
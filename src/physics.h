@@ -43,6 +43,8 @@ typedef struct physics_object
     // Linked list representation:
     uint8_t next_object;
     uint8_t previous_object;
+    // sprite showing this object (see projection.h), or zero:
+    uint8_t sprite;
     union
     {   uint8_t next_free; // used in root physics_object only.
         // Indices to collisions in the last frame, or zero.
@@ -0,0 +1,97 @@
+#include "bitbox.h"
+#include "cycles.h"
+#include "game.h"
+#include "profile.h"
+
+#include <string.h> // memset
+
+#if PROFILE_ENABLED
+#define PROFILE_BAR_W 32 // pixels for the whole line budget
+#define PROFILE_TOP_BAR_W 256 // pixels for the whole frame budget
+#define PROFILE_WORST_COLOR BYTE_PIXEL(255)
+
+uint8_t profile_overlay CCM_MEMORY;
+uint32_t profile_line_worst[SCREEN_H];
+uint16_t profile_line_histogram[SCREEN_H][PROFILE_BUCKETS];
+uint32_t profile_frame_cycles CCM_MEMORY;
+uint32_t profile_frame_worst CCM_MEMORY;
+uint32_t profile_sound_cycles CCM_MEMORY;
+uint32_t profile_sound_worst CCM_MEMORY;
+
+void profile_reset()
+{   // forgets the worst cases and histograms.
+    STATIC_ASSERT(PROFILE_BUCKETS == 8); // see profile_report
+    memset(profile_line_worst, 0, sizeof(profile_line_worst));
+    memset(profile_line_histogram, 0, sizeof(profile_line_histogram));
+    profile_frame_worst = 0;
+    profile_sound_worst = 0;
+}
+
+static void profile_bar(int x0, uint32_t width, uint32_t cycles, uint32_t worst, uint32_t budget)
+{   // draws cycles as a bar starting at x0, with width pixels for the whole budget.
+    pixel_t color;
+    if (4*(uint64_t)cycles < 3*(uint64_t)budget)
+        color = RGB(0, 200, 0);
+    else if (cycles <= budget)
+        color = RGB(230, 200, 0);
+    else
+        color = RGB(255, 0, 0);
+    uint64_t length = (uint64_t)cycles*width/budget;
+    pixel_t *dst = draw_buffer + x0;
+    for (uint32_t x = 0; x < width; ++x)
+        dst[x] = x < length ? color : 0;
+    uint64_t mark = (uint64_t)worst*width/budget;
+    dst[mark < width ? mark : width - 1] = PROFILE_WORST_COLOR;
+}
+
+void profile_line(uint32_t start)
+{   // call after drawing vga_line, with the cycles_now() from before drawing it.
+    uint32_t cycles = cycles_now() - start;
+    int line = vga_line;
+    if (line >= SCREEN_H)
+        return;
+    if (cycles > profile_line_worst[line])
+        profile_line_worst[line] = cycles;
+    uint32_t bucket = 4*(uint64_t)cycles/PROFILE_LINE_BUDGET;
+    uint16_t *count = &profile_line_histogram[line][bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1];
+    if (*count < 65535)
+        ++*count;
+
+    if (!profile_overlay)
+        return;
+    // drawn after the measurement, so the overlay itself doesn't count:
+    profile_bar(SCREEN_W - PROFILE_BAR_W, PROFILE_BAR_W, cycles, profile_line_worst[line], PROFILE_LINE_BUDGET);
+    if (line < 2)
+        profile_bar(0, PROFILE_TOP_BAR_W, profile_frame_cycles, profile_frame_worst, PROFILE_FRAME_BUDGET);
+    else if (line < 4)
+        profile_bar(0, PROFILE_TOP_BAR_W, profile_sound_cycles, profile_sound_worst, PROFILE_FRAME_BUDGET);
+}
+
+void profile_frame(uint32_t start)
+{   // call at the end of game_frame(), with the cycles_now() from its start.
+    profile_frame_cycles = cycles_now() - start;
+    if (profile_frame_cycles > profile_frame_worst)
+        profile_frame_worst = profile_frame_cycles;
+}
+
+void profile_sound(uint32_t start)
+{   // call at the end of game_snd_buffer(), with the cycles_now() from its start.
+    profile_sound_cycles = cycles_now() - start;
+    if (profile_sound_cycles > profile_sound_worst)
+        profile_sound_worst = profile_sound_cycles;
+}
+
+void profile_report()
+{   // message()s the worst cases, and the histograms of lines that came close to the budget.
+    message("profile: game_frame worst %d cycles, game_snd_buffer worst %d cycles, line budget %d\n",
+        (int)profile_frame_worst, (int)profile_sound_worst, (int)PROFILE_LINE_BUDGET);
+    for (int line = 0; line < SCREEN_H; ++line)
+    {   if (4*(uint64_t)profile_line_worst[line] < 3*(uint64_t)PROFILE_LINE_BUDGET)
+            continue;
+        const uint16_t *count = profile_line_histogram[line];
+        message("  line %d: worst %d cycles (%d%%), by quarter budget %d %d %d %d %d %d %d %d\n",
+            line, (int)profile_line_worst[line], (int)(100*(uint64_t)profile_line_worst[line]/PROFILE_LINE_BUDGET),
+            count[0], count[1], count[2], count[3], count[4], count[5], count[6], count[7]);
+    }
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "cycles.h"
+
+#include <stdint.h>
+
+// Cycle counts of the drawing in graph_line() (per vga_line), game_frame() and
+// game_snd_buffer().  Each vga_line keeps its worst case and a histogram in quarters
+// of the line budget.  profile_overlay shows this frame's cost of each line at the
+// right edge of the screen (green is fine, yellow is close to the budget, red is over,
+// with a white dot for the worst case), and the last game_frame() and game_snd_buffer()
+// costs at the top.  On the second gamepad, select toggles the overlay and start
+// reports the worst lines with message() and starts counting again.
+// Define PROFILE_ENABLED to 0 to compile it out.
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+// bucket b counts lines which took b/4 to (b+1)/4 of the line budget, the last one everything more:
+#define PROFILE_BUCKETS 8
+// drawing one line needs to be done before the next one gets displayed:
+#define PROFILE_LINE_BUDGET CYCLES_PER_LINE
+// game_frame() runs in vertical blank (45 lines of 525), though it gets interrupted by audio:
+#define PROFILE_FRAME_BUDGET (45*CYCLES_PER_LINE)
+
+#if PROFILE_ENABLED
+extern uint8_t profile_overlay;
+extern uint32_t profile_line_worst[240];
+extern uint16_t profile_line_histogram[240][PROFILE_BUCKETS];
+extern uint32_t profile_frame_cycles, profile_frame_worst;
+extern uint32_t profile_sound_cycles, profile_sound_worst;
+
+void profile_reset();
+void profile_line(uint32_t start);
+void profile_frame(uint32_t start);
+void profile_sound(uint32_t start);
+void profile_report();
+#else
+static inline void profile_reset() {}
+static inline void profile_line(uint32_t start) {}
+static inline void profile_frame(uint32_t start) {}
+static inline void profile_sound(uint32_t start) {}
+static inline void profile_report() {}
+#endif
+
+#endif
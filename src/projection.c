@@ -0,0 +1,83 @@
+#include "bitbox.h"
+#include "game.h"
+#include "landscape.h"
+#include "physics.h"
+#include "projection.h"
+#include "sprite.h"
+
+#include <math.h>
+#include <string.h> // memcmp
+
+// the boundary each object was projected from, to find out which ones moved since:
+static physics_boundary_t projection_built[MAX_PHYSICS_OBJECTS] CCM_MEMORY;
+static uint8_t projection_stale[MAX_PHYSICS_OBJECTS] CCM_MEMORY;
+
+void projection_bind(uint8_t object, uint8_t sprite)
+{   ASSERT(object > 0 && object < MAX_PHYSICS_OBJECTS);
+    ASSERT(sprite < MAX_SPRITES);
+    physics_object[object].sprite = sprite;
+    projection_stale[object] = 1;
+}
+
+static inline int32_t projection_fixed(float value)
+{   // world coordinate in pixels to fixed point, rounding down.
+    return (int32_t)floorf(value * PROJECTION_ONE);
+}
+
+static void projection_object(const physics_boundary_t *box, sprite_t *s)
+{   // sets the rectangle and depth of sprite s from the box, all in the world.
+    int32_t x0 = projection_fixed(box->corner_min[0]);
+    int32_t x1 = projection_fixed(box->corner_max[0]);
+    int32_t y0 = projection_fixed(box->corner_min[1] - box->corner_max[2]);
+    int32_t y1 = projection_fixed(box->corner_max[1] - box->corner_min[2]);
+    // round the top-left down and the bottom-right up to whole pixels (see landscape_project()):
+    int ix = x0 >> PROJECTION_SHIFT, iy = y0 >> PROJECTION_SHIFT;
+    int width = ((x1 + PROJECTION_ONE - 1) >> PROJECTION_SHIFT) - ix;
+    int height = ((y1 + PROJECTION_ONE - 1) >> PROJECTION_SHIFT) - iy;
+    // like sprite_depth(), starting a screen's height above y = 0:
+    int32_t iz = projection_fixed(box->corner_max[1]) + SCREEN_H*PROJECTION_ONE;
+    if (iz < 0)
+        iz = 0;
+    else if (iz > 65535)
+        iz = 65535;
+    if (ix < -32768 || ix > 32767 || iy < -32768 || iy > 32767)
+    {   // far enough away to not show up at all:
+        width = 0;
+        height = 0;
+    }
+    if (width > 255)
+        width = 255;
+    if (height > 255)
+        height = 255;
+    s->ix = ix;
+    s->iy = iy;
+    s->iz = iz;
+    s->width = width;
+    s->height = height;
+}
+
+void projection_frame()
+{   // projects every object with a sprite, in one pass over physics_object.
+    STATIC_ASSERT(PROJECTION_ONE == SPRITE_DEPTH_PER_PIXEL);
+
+    LL_ITERATE
+    (   physics_object, next_object, index, 0,
+        uint8_t sprite_index = physics_object[index].sprite;
+        const physics_boundary_t *box = &physics_object[index].entity.boundary;
+        if
+        (   sprite_index &&
+            (projection_stale[index] || memcmp(box, &projection_built[index], sizeof(*box)))
+        )
+        {   projection_built[index] = *box;
+            projection_stale[index] = 0;
+            sprite_t *s = &sprite[sprite_index];
+            sprite_t before = *s;
+            projection_object(box, s);
+            if
+            (   s->ix != before.ix || s->iy != before.iy || s->iz != before.iz ||
+                s->width != before.width || s->height != before.height
+            )
+                sprite_changed(sprite_index);
+        }
+    );
+}
@@ -0,0 +1,24 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <stdint.h>
+
+// Puts the sprite bound to each physics_object where its box shows up, with the same
+// view as landscape.h (x and y on the ground, z up).  Sprites are placed in the world,
+// at (x, y - z) and with the depth of y, and sprite_frame() takes the camera off, so
+// moving the camera doesn't change them.
+// Done in fixed point, PROJECTION_ONE units to a pixel, so that one unit is one step
+// of sprite iz and objects get the same depth as terrain at the same y.
+// Bitmap sprites keep their own size, with their top-left at the top-left of the box.
+#define PROJECTION_SHIFT 6
+#define PROJECTION_ONE (1 << PROJECTION_SHIFT)
+
+// shows physics_object[object] with sprite[sprite] from the next projection_frame() on,
+// or stops updating its sprite with sprite == 0.  Freeing the object also unbinds it.
+void projection_bind(uint8_t object, uint8_t sprite);
+
+// call once a frame after physics_frame() (and any camera move), before sprite_frame().
+// only sprites whose object moved get changed.
+void projection_frame();
+
+#endif
@@ -0,0 +1,150 @@
+#include "bitbox.h"
+#include "chip.h"
+#include "game.h"
+#include "scope.h"
+
+#define SCOPE_X 144
+#define SCOPE_WIDTH 160 // needs to be a multiple of 32
+#define SCOPE_COLOR RGB(120, 255, 120)
+#define SCOPE_AXIS_COLOR RGB(50, 90, 50)
+#define VU_X 16
+#define VU_WIDTH 112
+#define VU_PEAK_COLOR RGB(255, 255, 255)
+
+// scope_bits[y] has a bit set for each column of the scope to light up on line y:
+static uint32_t scope_bits[SCOPE_HEIGHT][SCOPE_WIDTH/32];
+static uint16_t scope_samples[CHIP_TAP_LEN];
+// volume meters, which fall off over time, and the peaks which fall off more slowly:
+static uint8_t scope_vu[CHIP_PLAYERS];
+static uint8_t scope_vu_peak[CHIP_PLAYERS];
+
+static const pixel_t vu_color[CHIP_PLAYERS] =
+{   RGB(255, 100, 100), RGB(255, 200, 80), RGB(80, 200, 255), RGB(200, 120, 255)
+};
+
+static inline int scope_mono(uint16_t sample)
+{   // both channels together, in [0, 510]
+    return (sample & 255) + (sample >> 8);
+}
+
+static inline int scope_row(uint16_t sample, int gain)
+{   // line of the scope for this sample, with +-gain going to the edges
+    int row = SCOPE_HEIGHT/2 - (scope_mono(sample) - 255)*(SCOPE_HEIGHT/2)/gain;
+    return row < 0 ? 0 : row >= SCOPE_HEIGHT ? SCOPE_HEIGHT - 1 : row;
+}
+
+void scope_frame(int enabled)
+{   // Call once a frame; decimates the latest sound into the lines of the scope.
+    // The tap only costs anything in the sound callback while enabled.
+    chip_tap_enabled = enabled;
+    if (!enabled)
+        return;
+
+    // The sound callback can write to the tap while we copy it, in which case try again:
+    uint32_t written;
+    int tries = 3;
+    do
+    {   written = chip_tap_written;
+        memcpy(scope_samples, chip_tap, sizeof(scope_samples));
+    }
+    while (written != chip_tap_written && --tries);
+    // oldest sample first:
+    int start = written % CHIP_TAP_LEN;
+
+    // look for a rising edge so the waveform stays put from frame to frame:
+    int trigger = 0;
+    for (int i=0; i<CHIP_TAP_LEN - 2*SCOPE_WIDTH - 1; ++i)
+    if
+    (   scope_mono(scope_samples[(start + i) % CHIP_TAP_LEN]) < 255 &&
+        scope_mono(scope_samples[(start + i + 1) % CHIP_TAP_LEN]) >= 255
+    )
+    {   trigger = i;
+        break;
+    }
+    start += trigger;
+
+    // scale the loudest sample to the top (or bottom) of the scope, quiet players are hard to see otherwise:
+    int gain = 16;
+    for (int i=0; i<2*SCOPE_WIDTH; ++i)
+    {   int value = scope_mono(scope_samples[(start + i) % CHIP_TAP_LEN]) - 255;
+        if (value > gain)
+            gain = value;
+        else if (-value > gain)
+            gain = -value;
+    }
+
+    memset(scope_bits, 0, sizeof(scope_bits));
+    int previous = -1;
+    for (int x=0; x<SCOPE_WIDTH; ++x)
+    {   // two samples per column, lighting up everything in between (and up to the last column):
+        int a = scope_row(scope_samples[(start + 2*x) % CHIP_TAP_LEN], gain);
+        int b = scope_row(scope_samples[(start + 2*x + 1) % CHIP_TAP_LEN], gain);
+        int low = a < b ? a : b;
+        int high = a < b ? b : a;
+        if (previous >= 0)
+        {   if (previous < low)
+                low = previous;
+            else if (previous > high)
+                high = previous;
+        }
+        previous = b;
+        for (int y=low; y<=high; ++y)
+            scope_bits[y][x/32] |= 1u << (x%32);
+    }
+
+    for (int i=0; i<CHIP_PLAYERS; ++i)
+    {   uint8_t volume = chip_tap_volume[i];
+        if (volume >= scope_vu[i])
+            scope_vu[i] = volume;
+        else
+            scope_vu[i] = scope_vu[i] > 8 ? scope_vu[i] - 8 : 0;
+        if (volume >= scope_vu_peak[i])
+            scope_vu_peak[i] = volume;
+        else if (scope_vu_peak[i])
+            --scope_vu_peak[i];
+    }
+}
+
+void scope_line(int delta_y, pixel_t color_bg)
+{   // Draws line delta_y (0 to SCOPE_HEIGHT-1) of the volume meters and the scope.
+    // Redraws the background too, since nothing else clears these lines.
+    STATIC_ASSERT(VU_X % 2 == 0 && VU_WIDTH % 2 == 0 && SCOPE_X % 2 == 0);
+    const pixel_pair_t bg = PIXEL_PAIR(color_bg, color_bg);
+    pixel_pair_t *dst = (pixel_pair_t *)(draw_buffer + VU_X);
+    int x = 0;
+    // two lines per player, with a line of space above and below:
+    int player = (delta_y - 1)/2;
+    if (delta_y >= 1 && player < CHIP_PLAYERS)
+    {   int width = scope_vu[player]*VU_WIDTH/256;
+        int peak = scope_vu_peak[player]*VU_WIDTH/256;
+        const pixel_pair_t vu = PIXEL_PAIR(vu_color[player], vu_color[player]);
+        for (; x + 2 <= width; x += 2)
+            *dst++ = vu;
+        if (x < width)
+        {   *dst++ = PIXEL_PAIR(vu_color[player], color_bg);
+            x += 2;
+        }
+        for (; x < VU_WIDTH; x += 2)
+            *dst++ = bg;
+        if (peak)
+            draw_buffer[VU_X + peak - 1] = VU_PEAK_COLOR;
+    }
+    else
+    {   for (; x < VU_WIDTH; x += 2)
+            *dst++ = bg;
+    }
+
+    // fill in the background (or axis), then light up the columns of the trace:
+    const pixel_t off = delta_y == SCOPE_HEIGHT/2 ? SCOPE_AXIS_COLOR : color_bg;
+    const pixel_pair_t off_pair = PIXEL_PAIR(off, off);
+    dst = (pixel_pair_t *)(draw_buffer + SCOPE_X);
+    for (x = 0; x < SCOPE_WIDTH; x += 2)
+        *dst++ = off_pair;
+    for (int i=0; i<SCOPE_WIDTH/32; ++i)
+    {   uint32_t bits = scope_bits[delta_y][i];
+        while (bits)
+        {   draw_buffer[SCOPE_X + 32*i + __builtin_ctz(bits)] = SCOPE_COLOR;
+            bits &= bits - 1;
+        }
+    }
+}
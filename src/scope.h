@@ -0,0 +1,14 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include "game.h" // pixel_t
+#include <stdint.h>
+
+// An oscilloscope of the sound being played, and volume meters for each player,
+// drawn 10 lines high (like one row of text in the editors).
+#define SCOPE_HEIGHT 10
+
+void scope_frame(int enabled);
+void scope_line(int delta_y, pixel_t color_bg);
+
+#endif
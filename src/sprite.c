@@ -1,24 +1,115 @@
 #include "bitbox.h"
 #include "game.h"
+#include "landscape.h"
 #include "sprite.h"
+#include "bitmaps.h"
 
 #include <assert.h>
 #include <stdlib.h> // rand
+#include <string.h> // memset
 
-uint16_t sprite_palette[16] CCM_MEMORY;
+#define SPRITE_DIRTY_EITHER (SPRITE_DIRTY | (SPRITE_DIRTY << 1))
+
+pixel_t sprite_palette[16] CCM_MEMORY;
 struct sprite sprite[MAX_SPRITES] CCM_MEMORY;
 
+typedef struct sprite_shown
+{   // the parts of a sprite that sprite_line() reads, with ix and iy on screen.
+    uint16_t iz;
+    int16_t iy, ix;
+    uint8_t width, height;
+    uint8_t colors;
+    uint8_t shape;
+} sprite_shown_t;
+
+typedef struct sprite_list
+{   // everything sprite_line() reads while drawing a frame, so that sprite[] can change meanwhile.
+
+    // All on-screen sprites, sorted by the vga_line they start on and then by depth;
+    // the ones starting on vga_line y are order[start[y]] up to order[start[y + 1]].
+    uint8_t order[MAX_SPRITES];
+    uint8_t order_count;
+    uint8_t start_stale; // order changed since start was set
+    uint8_t start[SCREEN_H + 1];
+    // For each vga_line, the sprites which stop being drawn on that line,
+    // as doubly-linked lists through next/previous_ending, ended by a 0.
+    // end_line is the bucket a sprite is in, or 0 if none.
+    uint8_t end_bucket[SCREEN_H];
+    uint8_t next_ending[MAX_SPRITES];
+    uint8_t previous_ending[MAX_SPRITES];
+    uint8_t end_line[MAX_SPRITES];
+    // sort key for each sprite in order, (starting vga_line << 16) | iz:
+    uint32_t key[MAX_SPRITES];
+    // size class (see shapes.h) and 16.16 step through its rows per vga_line, for each sprite in order:
+    uint8_t size_class[MAX_SPRITES];
+    uint32_t row_step[MAX_SPRITES];
+    // each sprite in order as it was when it got sorted:
+    sprite_shown_t shown[MAX_SPRITES];
+    // the camera it was sorted with, and landscape_depth_map as of then:
+    int16_t camera_x, camera_y;
+    uint16_t landscape[LANDSCAPE_ROWS][LANDSCAPE_COLUMNS];
+} sprite_list_t;
+
+// sprite_frame() prepares sprite_list[sprite_back] from sprite[], while sprite_line() draws
+// the other one; after sprite_commit(), sprite_line() swaps them over at vga_line 0.
+static sprite_list_t sprite_list[2] CCM_MEMORY;
+static volatile uint8_t sprite_back CCM_MEMORY;
+static uint8_t sprite_back_ready CCM_MEMORY; // sprite_frame() ran since the last sprite_commit()
+static volatile uint8_t sprite_commit_pending CCM_MEMORY; // the back list is ready to be shown
+// sprites which changed since either list was last prepared, with SPRITE_DIRTY set for each list it's stale in:
+static uint8_t sprite_dirty[MAX_SPRITES] CCM_MEMORY;
+static uint8_t sprite_dirty_count CCM_MEMORY;
+// Sprites in use which are within SPRITE_CULL_MARGIN of the screen around (sprite_near_x, sprite_near_y),
+// each with SPRITE_NEAR set.  Only these get sorted when the camera moves, and the list only gets
+// rebuilt from all sprites once the camera is more than SPRITE_CULL_MARGIN away from there.
+static uint8_t sprite_near[MAX_SPRITES] CCM_MEMORY;
+static uint8_t sprite_near_count CCM_MEMORY;
+static uint8_t sprite_near_valid CCM_MEMORY;
+static int16_t sprite_near_x CCM_MEMORY;
+static int16_t sprite_near_y CCM_MEMORY;
+// sprites being drawn on the current vga_line, ordered in z (small z to big z):
+static uint8_t sprite_active[SPRITE_LINE_LIMIT] CCM_MEMORY;
+static uint8_t sprite_active_count CCM_MEMORY;
+// first vga_line whose start and end buckets haven't been applied to sprite_active yet:
+static int16_t sprite_next_line CCM_MEMORY;
+// one bit per pixel of the current vga_line, set once a (nearer) sprite was drawn there:
+static uint32_t sprite_covered[SCREEN_W / 32] CCM_MEMORY;
+
+uint8_t sprite_line_limit = SPRITE_LINE_LIMIT;
+uint32_t sprite_line_overflows;
+uint8_t sprite_line_peak;
+
 void sprite_init()
 {   // setup the sprites to have the correct free linked list.
     LL_RESET(sprite, next_to_draw, previous_to_draw, MAX_SPRITES);
-    STATIC_ASSERT(ShapeCount <= 256);
+    STATIC_ASSERT(BitmapEnd <= 256);
     STATIC_ASSERT(MAX_SPRITES <= 256);
+    STATIC_ASSERT(SCREEN_W % 32 == 0); // for sprite_covered
+    for (int i = 0; i < MAX_SPRITES; ++i)
+        sprite[i].flags = 0;
+    for (int which = 0; which < 2; ++which)
+    {   sprite_list[which].order_count = 0;
+        sprite_list[which].start_stale = 0;
+        memset(sprite_list[which].start, 0, sizeof(sprite_list[which].start));
+        memset(sprite_list[which].end_bucket, 0, sizeof(sprite_list[which].end_bucket));
+        memset(sprite_list[which].end_line, 0, sizeof(sprite_list[which].end_line));
+        sprite_list[which].camera_x = landscape_camera_x;
+        sprite_list[which].camera_y = landscape_camera_y;
+    }
+    sprite_back = 0;
+    sprite_back_ready = 0;
+    sprite_commit_pending = 0;
+    sprite_next_line = 0;
+    sprite_dirty_count = 0;
+    sprite_near_count = 0;
+    sprite_near_valid = 0;
+    sprite_active_count = 0;
 
     // Set the palette to something reasonable.
-    static const uint16_t colors[16] = {
+    static const pixel_t colors[16] = {
         RGB(0, 0, 0),
         RGB(157, 157, 157),
-        (1<<15) - 1,
+        RGB(255, 255, 255),
         RGB(224, 111, 139),
         RGB(190, 38, 51),
         RGB(235, 137, 49),
@@ -36,21 +127,59 @@ void sprite_init()
     memcpy(sprite_palette, colors, sizeof(colors));
 }
 
+uint16_t sprite_depth(float y)
+{   // converts a world y into the fixed-point value used for sprite[].iz,
+    // clamping to what is representable.
+    float z = (y + SCREEN_H) * SPRITE_DEPTH_PER_PIXEL;
+    if (z <= 0.0f)
+        return 0;
+    if (z >= 65535.0f)
+        return 65535;
+    return (uint16_t)(z + 0.5f);
+}
+
+void sprite_changed(uint8_t index)
+{   // marks sprite[index] for re-sorting into both lists, the next time each gets prepared.
+    ASSERT(index > 0 && index < MAX_SPRITES);
+    if (!(sprite[index].flags & SPRITE_DIRTY_EITHER))
+    {   // at most once in sprite_dirty, since it only leaves there once clean in both lists:
+        ASSERT(sprite_dirty_count < MAX_SPRITES);
+        sprite_dirty[sprite_dirty_count++] = index;
+    }
+    sprite[index].flags |= SPRITE_DIRTY_EITHER;
+}
+
+void sprite_move(uint8_t index, int16_t ix, int16_t iy, uint16_t iz)
+{   // sets the position of sprite[index].
+    if (sprite[index].ix == ix && sprite[index].iy == iy && sprite[index].iz == iz)
+        return;
+    sprite[index].ix = ix;
+    sprite[index].iy = iy;
+    sprite[index].iz = iz;
+    sprite_changed(index);
+}
+
+static uint8_t sprite_allocate()
+{   // add new sprite to the draw_order list, which holds all sprites in use (in no particular order).
+    // sprite_line() only looks at the sprite lists, so we just have to update the draw_order list.
+    LL_NEW(sprite, next_to_draw, previous_to_draw, MAX_SPRITES);
+}
+
 uint8_t sprite_new()
 {   // returns an index to a free sprite, or zero if none.
-    // add new sprite to the draw_order list;
-    // it's not sorted yet but that will happen in the sprite_frame();
-    // users haven't updated the sprite details yet anyway so it doesn't
-    // make sense to try and find any other spot for it yet.
-    // the visible list shouldn't be in use yet (that is used only in sprite_line())
-    // so we just have to update the draw_order list.
-    LL_NEW(sprite, next_to_draw, previous_to_draw, MAX_SPRITES);
+    // sprite_frame() will put it in the right place once its details are set.
+    uint8_t index = sprite_allocate();
+    if (index)
+    {   // it may still be in the lists from before it was freed, until they get prepared again:
+        sprite[index].flags |= SPRITE_IN_USE;
+        sprite_changed(index);
+    }
+    return index;
 }
 
 static inline void sprite_detach_from_draw(uint8_t index)
 {   // removes sprite[index] from its current place in the linked list;
-    // this function DOES NOT update sprite[index].next/prev;
-    // that is something you should do based on where you are trying to attach it.
+    // this function DOES NOT update sprite[index].next/prev.
     uint8_t next_to_draw = sprite[index].next_to_draw;
     uint8_t previous_to_draw = sprite[index].previous_to_draw;
 
@@ -60,221 +189,529 @@ static inline void sprite_detach_from_draw(uint8_t index)
     sprite[next_to_draw].previous_to_draw = previous_to_draw;
 }
 
-static inline void sprite_attach_to_draw(uint8_t index, uint8_t previous_to_draw)
-{   // inserts sprite[index] in linked list between sprite[previous_to_draw] and sprite[previous_index].next_to_draw.
-    // assumes that sprite[index]'s current outgoing connections don't need to be updated.
-    // we should only do sprite_attach_to_draw(index, ...) after a corresponding sprite_detach_from_draw(index).
-
-    // update linkages from outside sprite[index] towards sprite[index]:
-    uint8_t next_to_draw = sprite[previous_to_draw].next_to_draw;
-    sprite[previous_to_draw].next_to_draw = index;
-    ASSERT(sprite[next_to_draw].previous_to_draw == previous_to_draw);
-    sprite[next_to_draw].previous_to_draw = index;
-
-    // update the linkages from sprite[index] outward:
-    sprite[index].next_to_draw = next_to_draw;
-    sprite[index].previous_to_draw = previous_to_draw;
-}
-
 void sprite_free(uint8_t index)
 {   // frees the sprite at the given index; its values should not be modified any more.
 
-    // remove from draw_order list;
-    // the visible list shouldn't be in use right now, but will pick up on changes in draw_order.
+    // remove from draw_order list; each sprite list drops it when it next gets prepared.
     sprite_detach_from_draw(index);
+    sprite_changed(index);
+    sprite[index].flags &= ~SPRITE_IN_USE;
 
     // update the free list:
     LL_FREE(sprite, next_to_draw, previous_to_draw, index);
 }
 
-static inline void sprite_insert_before_visible(uint8_t index, uint8_t next_visible)
-{   // inserts sprite[index] into visible list right before sprite[next_visible]
-    // and after sprite[next_visible].previous_visible
+static inline void sprite_deactivate(uint8_t index)
+{   // removes sprite[index] from the active set, if it's there (it may have been dropped).
+    for (int i = 0; i < sprite_active_count; ++i)
+    if (sprite_active[i] == index)
+    {   --sprite_active_count;
+        memmove(&sprite_active[i], &sprite_active[i + 1], sprite_active_count - i);
+        return;
+    }
+}
 
-    uint8_t previous_visible = sprite[next_visible].previous_visible;
-    ASSERT(sprite[previous_visible].next_visible == next_visible);
+static inline void sprite_fill_span(pixel_t *dst, int length, pixel_t color)
+{   // fills length pixels starting at dst, two pixels at a time where possible.
+    if ((uintptr_t)dst & sizeof(pixel_t))
+    {   // get to a pixel_pair_t boundary first:
+        *dst++ = color;
+        --length;
+    }
+    pixel_pair_t *dst_pair = (pixel_pair_t *)dst;
+    pixel_pair_t color_pair = PIXEL_PAIR(color, color);
+    for (; length >= 2; length -= 2)
+        *dst_pair++ = color_pair;
+    if (length > 0)
+        *(pixel_t *)dst_pair = color;
+}
 
-    sprite[previous_visible].next_visible = index;
-    sprite[next_visible].previous_visible = index;
+static inline void sprite_fill_uncovered(int x0, int x1, pixel_t color, uint32_t hidden_columns)
+{   // draws color from x0 up to (but not including) x1 wherever sprite_covered is not yet set,
+    // then marks all of it as covered.  pixels in LANDSCAPE_CELL columns set in hidden_columns
+    // are behind terrain, so they get covered without drawing.
+    while (x0 < x1)
+    {   int word = x0 / 32;
+        int last_bit = x1 - word * 32 - 1;
+        if (last_bit > 31)
+            last_bit = 31;
+        uint32_t mask = (~0u << (x0 & 31)) & (~0u >> (31 - last_bit));
+        uint32_t uncovered = mask & ~sprite_covered[word];
+        sprite_covered[word] |= mask;
+        STATIC_ASSERT(LANDSCAPE_CELL == 16);
+        if (hidden_columns & (1 << (2 * word)))
+            uncovered &= 0xffff0000;
+        if (hidden_columns & (2 << (2 * word)))
+            uncovered &= 0x0000ffff;
+        while (uncovered)
+        {   // fill each run of uncovered pixels in this word:
+            int start = __builtin_ctz(uncovered);
+            uint32_t run = uncovered >> start;
+            int length = ~run ? __builtin_ctz(~run) : 32;
+            sprite_fill_span(draw_buffer + word * 32 + start, length, color);
+            uncovered &= ~(length == 32 ? ~0u : ((1u << length) - 1) << start);
+        }
+        x0 = word * 32 + last_bit + 1;
+    }
+}
 
-    sprite[index].next_visible = next_visible;
-    sprite[index].previous_visible = previous_visible;
+static inline void sprite_draw_bitmap_row(const sprite_shown_t *s, int sprite_y, uint32_t hidden_columns)
+{   // draws the opaque runs of one row of a bitmap sprite; transparent runs are skipped over.
+    const bitmap_t *b = &bitmap[s->shape - ShapeCount];
+    int row = b->first_row + sprite_y;
+    int x = s->ix;
+    for (int i = bitmap_rows[row]; i < bitmap_rows[row + 1]; ++i)
+    {   const uint8_t *span = bitmap_spans[i];
+        x += span[0];
+        int x0 = x < 0 ? 0 : x;
+        x += span[1];
+        int x1 = x > SCREEN_W ? SCREEN_W : x;
+        if (x0 < x1)
+            sprite_fill_uncovered(x0, x1, sprite_palette[span[2]], hidden_columns);
+    }
 }
 
-static inline void sprite_add_to_visible(uint8_t index)
-{
-    uint8_t next_visible = sprite[0].next_visible;
-    while (next_visible)
-    {   // find out where sprite[index] belongs
-        if (sprite[next_visible].iz >= sprite[index].iz)
-            break;
+static inline void sprite_activate_line(const sprite_list_t *list, int line)
+{   // adds the sprites starting on the given line to the active set.
+    // they are already sorted by depth, so one walk through the active set puts all of them in place.
+    int position = 0;
+    for (int i = list->start[line]; i < list->start[line + 1]; ++i)
+    {   uint8_t index = list->order[i];
+        while (position < sprite_active_count && list->shown[sprite_active[position]].iz < list->shown[index].iz)
+            ++position;
+        // sprite_active[position] (if any) has iz >= sprite[index].iz,
+        // which means it has higher drawing priority.
+        if (sprite_active_count >= sprite_line_limit || sprite_active_count >= SPRITE_LINE_LIMIT)
+        {   // too many sprites on this line, drop whichever is furthest back for the rest of the frame:
+            ++sprite_line_overflows;
+            if (position == 0)
+                continue;
+            // the slot freed at the back moves up to where sprite[index] goes:
+            --position;
+            memmove(&sprite_active[0], &sprite_active[1], position);
+            sprite_active[position++] = index;
+            continue;
+        }
+        memmove(&sprite_active[position + 1], &sprite_active[position], sprite_active_count - position);
+        sprite_active[position++] = index;
+        ++sprite_active_count;
     }
-    // if next_visible == 0, then
-    //   nothing else in the list now, or the last element which should be visible:
-    // otherwise, sprite[next_visible].iz >= sprite[index].iz,
-    //   which means the next_visible sprite has higher drawing priority.
-    sprite_insert_before_visible(index, next_visible);
 }
 
 void sprite_line()
-{   // add any new sprites to the draw line, and remove any that are no longer visible.
-    // then draw sprites based on landscape iz-order.
-
-    // check to remove sprites first, since that will make the list smaller when adding to it
-    uint8_t visible = sprite[0].next_visible;
+{   // add any sprites which start on this vga_line, and remove any that ended on the line before.
+    // then draw sprites based on landscape iz-order, nearest first.
+    // call it on the vga_lines (from 0 to SCREEN_H-1) after sprite_frame(); lines it isn't called on
+    // (e.g. under the game message) are caught up on the next call, so nothing is missed or left over.
     const int16_t vga16 = vga_line;
-    while (visible)
-    {   int bottom16 = sprite[visible].iy + sprite[visible].height;
-        if (vga16 >= bottom16)
-        {   // sprite[visible] is actually not visible
-            uint8_t next_visible = sprite[visible].next_visible;
-            uint8_t previous_visible = sprite[visible].previous_visible;
-
-            ASSERT(sprite[previous_visible].next_visible == visible);
-            sprite[previous_visible].next_visible = next_visible;
-            ASSERT(sprite[next_visible].previous_visible == visible);
-            sprite[next_visible].previous_visible = previous_visible;
-
-            visible = next_visible;
+    ASSERT(vga16 >= 0 && vga16 < SCREEN_H);
+    if (vga16 == 0 || vga16 < sprite_next_line)
+    {   // a new frame, show the list sprite_commit() handed over (if any):
+        if (sprite_commit_pending)
+        {   sprite_back = !sprite_back;
+            sprite_commit_pending = 0;
         }
-        else 
-            visible = sprite[visible].next_visible;
+        sprite_active_count = 0;
+        sprite_next_line = 0;
     }
+    const sprite_list_t *list = &sprite_list[!sprite_back];
+
+    // apply every line since the last call, usually just this one.
+    // remove sprites first, since that will make the active set smaller when adding to it.
+    for (; sprite_next_line <= vga16; ++sprite_next_line)
+    {   for (uint8_t index = list->end_bucket[sprite_next_line]; index; index = list->next_ending[index])
+            sprite_deactivate(index);
+        sprite_activate_line(list, sprite_next_line);
+    }
+    if (sprite_active_count > sprite_line_peak)
+        sprite_line_peak = sprite_active_count;
+
+    // actually draw the sprites that are visible on this vga_line,
+    // front to back so that nothing gets drawn over pixels a nearer sprite already covered:
+    memset(sprite_covered, 0, sizeof(sprite_covered));
+    const uint16_t *landscape_row = list->landscape[vga16 / LANDSCAPE_CELL];
+    for (int i = sprite_active_count - 1; i >= 0; --i)
+    {   const sprite_shown_t *visible_sprite = &list->shown[sprite_active[i]];
+        int sprite_y = vga16 - visible_sprite->iy;
+        ASSERT(sprite_y >= 0 && sprite_y < visible_sprite->height);
+        // find out which columns of the sprite are behind the terrain:
+        uint32_t hidden_columns = 0;
+        {   int c0 = visible_sprite->ix < 0 ? 0 : visible_sprite->ix / LANDSCAPE_CELL;
+            int c1 = (visible_sprite->ix + visible_sprite->width + LANDSCAPE_CELL - 1) / LANDSCAPE_CELL;
+            if (c1 > LANDSCAPE_COLUMNS)
+                c1 = LANDSCAPE_COLUMNS;
+            for (int c = c0; c < c1; ++c)
+            if (landscape_row[c] > visible_sprite->iz)
+                hidden_columns |= 1 << c;
+        }
+        if (visible_sprite->shape >= ShapeCount)
+        {   sprite_draw_bitmap_row(visible_sprite, sprite_y, hidden_columns);
+            continue;
+        }
+        // one table lookup for this row of the shape, scaled from its size class to the sprite width:
+        int size_class = list->size_class[sprite_active[i]];
+        int row = (sprite_y * list->row_step[sprite_active[i]]) >> 16;
+        const uint8_t *span = shape_spans[visible_sprite->shape][SHAPE_ROW_OFFSET(size_class) + row];
+        int x[6];
+        for (int j = 0; j < 6; ++j)
+        {   int offset = visible_sprite->ix + ((span[j] * visible_sprite->width) >> (SHAPE_MIN_SIZE_SHIFT + size_class));
+            x[j] = offset < 0 ? 0 : offset > SCREEN_W ? SCREEN_W : offset;
+        }
+        pixel_t color1 = sprite_palette[visible_sprite->colors & 15];
+        if (x[0] < x[1])
+            sprite_fill_uncovered(x[0], x[1], color1, hidden_columns);
+        if (x[2] < x[3])
+            sprite_fill_uncovered(x[2], x[3], sprite_palette[visible_sprite->colors >> 4], hidden_columns);
+        if (x[4] < x[5])
+            sprite_fill_uncovered(x[4], x[5], color1, hidden_columns);
+    }
+}
 
-    // add sprites:
-    uint8_t check_next_for_visible = sprite[0].check_next_for_visible;
-    while (!check_next_for_visible)
-    {   const struct sprite *maybe_next = &sprite[check_next_for_visible];
-        if (maybe_next->iy > vga16)
-        {   // maybe_next may be on-screen, but it's definitely below the current vga_line
-            break;
+static void sprite_radix_pass(const sprite_list_t *list, const uint8_t *from, uint8_t *to, int count, int shift)
+{   // stable counting sort of the sprite indices in `from` into `to`,
+    // using the byte of list->key at `shift`.
+    uint8_t offset[256];
+    memset(offset, 0, sizeof(offset));
+    for (int i = 0; i < count; ++i)
+        ++offset[(list->key[from[i]] >> shift) & 255];
+    int total = 0;
+    for (int digit = 0; digit < 256; ++digit)
+    {   int digit_count = offset[digit];
+        offset[digit] = total;
+        total += digit_count;
+    }
+    for (int i = 0; i < count; ++i)
+        to[offset[(list->key[from[i]] >> shift) & 255]++] = from[i];
+}
+
+static inline int sprite_lower_bound(const sprite_list_t *list, uint32_t key)
+{   // returns the first position in list->order with a key not less than `key`.
+    int low = 0, high = list->order_count;
+    while (low < high)
+    {   int mid = (low + high) / 2;
+        if (list->key[list->order[mid]] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static void sprite_unsort(int which, uint8_t index)
+{   // removes sprite[index] from sprite_list[which]'s order and its end bucket, if it's in them.
+    if (!(sprite[index].flags & (SPRITE_SORTED << which)))
+        return;
+    sprite[index].flags &= ~(SPRITE_SORTED << which);
+    sprite_list_t *list = &sprite_list[which];
+    list->start_stale = 1;
+
+    int i = sprite_lower_bound(list, list->key[index]);
+    while (list->order[i] != index)
+    {   ++i;
+        ASSERT(i < list->order_count);
+    }
+    --list->order_count;
+    memmove(&list->order[i], &list->order[i + 1], list->order_count - i);
+
+    uint8_t line = list->end_line[index];
+    if (line)
+    {   uint8_t previous = list->previous_ending[index];
+        uint8_t next = list->next_ending[index];
+        if (previous)
+            list->next_ending[previous] = next;
+        else
+            list->end_bucket[line] = next;
+        if (next)
+            list->previous_ending[next] = previous;
+        list->end_line[index] = 0;
+    }
+}
+
+static inline void sprite_fix_size(sprite_t *s)
+{   // bitmaps are always drawn at their own size:
+    if (s->shape >= ShapeCount)
+    {   ASSERT(s->shape < BitmapEnd);
+        s->width = bitmap[s->shape - ShapeCount].width;
+        s->height = bitmap[s->shape - ShapeCount].height;
+    }
+}
+
+static int sprite_is_near(uint8_t index)
+{   // returns 1 if sprite[index] is in use, can be seen, and is within SPRITE_CULL_MARGIN
+    // of the screen with the camera at (sprite_near_x, sprite_near_y).
+    sprite_t *s = &sprite[index];
+    if (!(s->flags & SPRITE_IN_USE))
+        return 0;
+    sprite_fix_size(s);
+    if (!s->width || !s->height || s->shape == NoShape_Invisible)
+        return 0;
+    int x = s->ix - sprite_near_x, y = s->iy - sprite_near_y;
+    return x + s->width > -SPRITE_CULL_MARGIN && x < SCREEN_W + SPRITE_CULL_MARGIN &&
+        y + s->height > -SPRITE_CULL_MARGIN && y < SCREEN_H + SPRITE_CULL_MARGIN;
+}
+
+static int sprite_set_key(sprite_list_t *list, uint8_t index)
+{   // computes the sort key of sprite[index] and puts it into its end bucket in the list;
+    // returns 0 if it shouldn't be drawn at all (entirely off-screen or empty).
+    sprite_t *s = &sprite[index];
+    sprite_fix_size(s);
+    int left = s->ix - list->camera_x;
+    int top = s->iy - list->camera_y;
+    int bottom = top + s->height;
+    if (!s->width || !s->height || s->shape == NoShape_Invisible ||
+        bottom <= 0 || top >= SCREEN_H || left + s->width <= 0 || left >= SCREEN_W)
+        return 0;
+    sprite_shown_t *shown = &list->shown[index];
+    shown->iz = s->iz;
+    shown->iy = top;
+    shown->ix = left;
+    shown->width = s->width;
+    shown->height = s->height;
+    shown->colors = s->colors;
+    shown->shape = s->shape;
+    // use the smallest size class with enough rows, so most of it gets seen:
+    int size_class = 0;
+    int size = s->width > s->height ? s->width : s->height;
+    while (size_class < SHAPE_SIZE_CLASSES - 1 && (1 << (SHAPE_MIN_SIZE_SHIFT + size_class)) < size)
+        ++size_class;
+    list->size_class[index] = size_class;
+    // round up, so that e.g. the middle vga_line of the sprite lands exactly on the middle row:
+    list->row_step[index] = (((uint32_t)1 << (16 + SHAPE_MIN_SIZE_SHIFT + size_class)) + s->height - 1) / s->height;
+    if (top < 0)
+        top = 0;
+    list->key[index] = ((uint32_t)top << 16) | shown->iz;
+    if (bottom < SCREEN_H)
+    {   // otherwise it's still visible at the end of the frame, and the list is reset anyway.
+        uint8_t next = list->end_bucket[bottom];
+        list->next_ending[index] = next;
+        list->previous_ending[index] = 0;
+        if (next)
+            list->previous_ending[next] = index;
+        list->end_bucket[bottom] = index;
+        list->end_line[index] = bottom;
+    }
+    return 1;
+}
+
+static void sprite_sort_all(int which)
+{   // sorts all on-screen sprites into sprite_list[which] from scratch.
+    // they're all in sprite_near, so sprites far from the camera cost nothing here.
+    static uint8_t unsorted[MAX_SPRITES];
+    sprite_list_t *list = &sprite_list[which];
+    int count = 0;
+    memset(list->end_bucket, 0, sizeof(list->end_bucket));
+    memset(list->end_line, 0, sizeof(list->end_line));
+
+    // this includes any freed sprites still in the list:
+    for (int i = 0; i < list->order_count; ++i)
+        sprite[list->order[i]].flags &= ~(SPRITE_SORTED << which);
+    for (int i = 0; i < sprite_dirty_count; ++i)
+        sprite[sprite_dirty[i]].flags &= ~(SPRITE_DIRTY << which);
+    for (int i = 0; i < sprite_near_count; ++i)
+    {   uint8_t index = sprite_near[i];
+        if (sprite_set_key(list, index))
+        {   sprite[index].flags |= SPRITE_SORTED << which;
+            unsorted[count++] = index;
         }
-        // maybe_next is on-screen or above the screen.
-        // only draw things on-screen and that have a non-zero height:
-        if (maybe_next->iy + maybe_next->height > 0 && maybe_next->height)
-            sprite_add_to_visible(check_next_for_visible);
-        // update the sprite we should check next:
-        check_next_for_visible = sprite[check_next_for_visible].next_to_draw;
     }
-    sprite[0].check_next_for_visible = check_next_for_visible;
-
-    // actually draw the sprites that are visible on this vga_line:
-    uint16_t colors[2];
-    LL_ITERATE(sprite, next_visible, index, 0,
-        // TODO: generate a landscape z-order before this frame, maybe for every "tile" (e.g. every 16 pixels)
-        sprite_t *visible_sprite = &sprite[index];
-        colors[0] = sprite_palette[sprite->colors & 15];
-        colors[1] = sprite_palette[sprite->colors >> 4];
-        uint8_t sprite_y = vga16 - sprite->iy;
-        ASSERT(sprite_y >= 0 && sprite_y < sprite->height);
-        uint16_t *dst = draw_buffer + sprite->ix;
-        uint16_t *max_dst = dst + sprite->width;
-        if (dst < draw_buffer)
-            dst = draw_buffer;
-        if (max_dst > draw_buffer + SCREEN_W)
-            max_dst = draw_buffer + SCREEN_W;
-        ASSERT(dst < max_dst);
-        switch (visible_sprite->shape)
-        {   case Rectangle_TopHalfBottomHalf:
-                if (sprite_y < sprite->height / 2)
-                while (dst < max_dst)
-                    *dst++ = colors[0];
-                else
-                while (dst < max_dst)
-                    *dst++ = colors[1];
-                break;
-            default:
-                // Ignore
-                break;
+
+    // least-significant digit first, so the last pass sorts by starting vga_line:
+    sprite_radix_pass(list, unsorted, list->order, count, 0);
+    sprite_radix_pass(list, list->order, unsorted, count, 8);
+    sprite_radix_pass(list, unsorted, list->order, count, 16);
+    list->order_count = count;
+    list->start_stale = 1;
+}
+
+static void sprite_resort(int which, uint8_t index)
+{   // puts a changed (or freed) sprite[index] back in the right place in sprite_list[which].
+    sprite_unsort(which, index);
+    sprite_list_t *list = &sprite_list[which];
+    if (!(sprite[index].flags & SPRITE_IN_USE) || !sprite_set_key(list, index))
+        return;
+    sprite[index].flags |= SPRITE_SORTED << which;
+    // after any sprites with the same key:
+    int i = sprite_lower_bound(list, list->key[index] + 1);
+    memmove(&list->order[i + 1], &list->order[i], list->order_count - i);
+    list->order[i] = index;
+    ++list->order_count;
+    list->start_stale = 1;
+}
+
+static void sprite_find_near()
+{   // culls all sprites in use down to the ones near the camera, into sprite_near.
+    for (int i = 0; i < sprite_near_count; ++i)
+        sprite[sprite_near[i]].flags &= ~SPRITE_NEAR;
+    sprite_near_x = landscape_camera_x;
+    sprite_near_y = landscape_camera_y;
+    sprite_near_valid = 1;
+    sprite_near_count = 0;
+    LL_ITERATE(sprite, next_to_draw, index, 0,
+        if (sprite_is_near(index))
+        {   sprite[index].flags |= SPRITE_NEAR;
+            sprite_near[sprite_near_count++] = index;
         }
     );
 }
 
-static inline float sprite_compare(uint8_t index1, uint8_t index2)
-{   // return <0 if sprite[index1] should go before sprite[index2] in the draw order,
-    // return >0 if sprite[index1] should go after sprite[index2] in the draw order,
-    // return  0 if they are equal in draw order.
-    const struct sprite *sprite1 = &sprite[index1];
-    const struct sprite *sprite2 = &sprite[index2];
-    int16_t compare_iy = sprite1->iy - sprite2->iy;
-    if (compare_iy == 0)
-    {   // sprite1->iy == sprite2->iy
-        // TODO: see if it's worth this extra cost to make sure we are z-ordered.
-        // adding to visible list will do a sorted insert anyway based on iz.
-        return sprite1->iz - sprite2->iz;
+static void sprite_update_near()
+{   // adds changed sprites to sprite_near if they came near the camera, and drops those that left
+    // (or were freed).  the camera needs to be within SPRITE_CULL_MARGIN of where sprite_near is for.
+    int dropped = 0;
+    for (int i = 0; i < sprite_dirty_count; ++i)
+    {   uint8_t index = sprite_dirty[i];
+        if (sprite_is_near(index))
+        {   if (!(sprite[index].flags & SPRITE_NEAR))
+            {   sprite[index].flags |= SPRITE_NEAR;
+                sprite_near[sprite_near_count++] = index;
+            }
+        }
+        else if (sprite[index].flags & SPRITE_NEAR)
+        {   sprite[index].flags &= ~SPRITE_NEAR;
+            dropped = 1;
+        }
+    }
+    if (!dropped)
+        return;
+    int count = 0;
+    for (int i = 0; i < sprite_near_count; ++i)
+    if (sprite[sprite_near[i]].flags & SPRITE_NEAR)
+        sprite_near[count++] = sprite_near[i];
+    sprite_near_count = count;
+}
+
+void sprite_frame()
+{   // Prepares the sprite list that sprite_commit() shows next: re-sorts any sprites which changed
+    // by the vga_line they start on and their depth, and puts them into the bucket for the vga_line
+    // they stop being drawn on.  Sprites which are entirely off-screen are skipped.
+    // Can be called at any point in the frame, since sprite_line() draws from the other list.
+    if (sprite_commit_pending)
+    {   // the last commit isn't shown yet (the frame ran late), leave the list alone until it is;
+        // the changed sprites stay dirty, so they get sorted next time.
+        return;
     }
-    else if (compare_iy < 0)
-    {   // sprite1->iy < sprite2->iy
-        return -1.0f;
+    int which = sprite_back;
+    sprite_list_t *list = &sprite_list[which];
+    if
+    (   !sprite_near_valid ||
+        abs(landscape_camera_x - sprite_near_x) > SPRITE_CULL_MARGIN ||
+        abs(landscape_camera_y - sprite_near_y) > SPRITE_CULL_MARGIN
+    )
+        sprite_find_near();
+    else
+        sprite_update_near();
+
+    if
+    (   landscape_camera_x != list->camera_x || landscape_camera_y != list->camera_y ||
+        sprite_dirty_count > SPRITE_RESORT_ALL_COUNT
+    )
+    {   // every sprite moved on screen, or radix sorting everything is cheaper than lots of binary insertions
+        list->camera_x = landscape_camera_x;
+        list->camera_y = landscape_camera_y;
+        sprite_sort_all(which);
     }
     else
-    {   // compare_iy > 0: sprite1->iy > sprite2->iy
-        return 1.0f;
+    {   for (int i = 0; i < sprite_dirty_count; ++i)
+        {   uint8_t index = sprite_dirty[i];
+            if (!(sprite[index].flags & (SPRITE_DIRTY << which)))
+                continue; // only stale in the other list
+            sprite[index].flags &= ~(SPRITE_DIRTY << which);
+            sprite_resort(which, index);
+        }
+    }
+    // keep whatever the other list still needs, for when it gets prepared after the next commit:
+    int count = 0;
+    for (int i = 0; i < sprite_dirty_count; ++i)
+    if (sprite[sprite_dirty[i]].flags & SPRITE_DIRTY_EITHER)
+        sprite_dirty[count++] = sprite_dirty[i];
+    sprite_dirty_count = count;
+
+    if (list->start_stale)
+    {   // find where each vga_line starts in order:
+        int i = 0;
+        for (int y = 0; y < SCREEN_H; ++y)
+        {   list->start[y] = i;
+            while (i < list->order_count && (int)(list->key[list->order[i]] >> 16) == y)
+                ++i;
+        }
+        ASSERT(i == list->order_count);
+        list->start[SCREEN_H] = list->order_count;
+        list->start_stale = 0;
     }
+    // the terrain can change while the other list is being drawn, so keep it as of now:
+    memcpy(list->landscape, landscape_depth_map, sizeof(list->landscape));
+    sprite_back_ready = 1;
 }
 
-static inline void sprite_push_back_to_sort(uint8_t sort_this)
-{   // We can assume everything in the list from sprite[0].next_to_draw
-    // to sprite[sort_this].previous_to_draw is sorted.  From here,
-    // push down sprite[sort_this] to the right position in the list.
-    uint8_t check_sprite = sprite[sort_this].previous_to_draw;
-    if (!check_sprite ||
-        sprite_compare(sort_this, check_sprite) >= 0.f
-    ){  // nothing to do here, list has only one element or is already sorted
-        return;
+void sprite_commit()
+{   // Call once at the end of each frame: sprite_line() draws the list sprite_frame() prepared
+    // from the next vga_line 0 on, if there is one.  Only the swap waits for vga_line 0, so this
+    // can't tear the frame being drawn even if the frame logic runs late.
+    if (sprite_back_ready)
+    {   sprite_commit_pending = 1;
+        sprite_back_ready = 0;
     }
-    // can update at least once since sprite[sort_this] < sprite[check_sprite]
-    // wherever we end up, we will need to detach it from where it currently is:
-    sprite_detach_from_draw(sort_this);
-    while (1)
-    {   // keep diving down until we find where sprite[sort_this] should be;
-        // since it's a linked list we don't need to submerge sprite[sort_this]
-        // at every step, we just need to find the final position
-        // and update the links.
-        check_sprite = sprite[check_sprite].previous_to_draw;
-        if (!check_sprite || sprite_compare(sort_this, check_sprite) >= 0.f)
-        {   // if check_sprite == 0, sprite[sort_this] goes at very front of list
-            // else: sprite[sort_this] == sprite[check_sprite] or sprite[sort_this] > sprite[check_sprite].
-            // in either case, put sprite[sort_this] just after sprite[check_sprite]
-            sprite_attach_to_draw(sort_this, check_sprite);
-            return;
-        }
-        // if we get here, sprite[sort_this] < sprite[check_sprite]
-        // keep going, sort_this might be smaller than earlier sprites.
-        // check_sprite is updated at the start of the loop, so don't do it here.
+}
+
+#ifdef EMULATOR
+static pixel_t test_sprite_pixel(int x, int y, int skip_from, int skip_to)
+{   // draws a whole frame of sprites, returning the pixel at (x, y) on screen.
+    // lines from skip_from up to (but not including) skip_to are not drawn at all.
+    memset(landscape_depth_map, 0, sizeof(landscape_depth_map));
+    sprite_frame();
+    sprite_commit();
+    pixel_t pixel = 0;
+    for (vga_line = 0; vga_line < SCREEN_H; ++vga_line)
+    {   if (vga_line >= skip_from && vga_line < skip_to)
+            continue;
+        memset(draw_buffer, 0, SCREEN_W*sizeof(pixel_t));
+        sprite_line();
+        if (vga_line == y)
+            pixel = draw_buffer[x];
     }
+    return pixel;
 }
 
-void sprite_frame()
-{   // Puts all sprites into order based on when they will first appear on-screen in the y direction.
-
-    // TODO: use qsort if we're having difficulties keeping CPU within bitbox requirements
-    // insertion sort all the drawing sprites on the map
-    uint8_t sorted_until = sprite[0].next_to_draw;
-    if (!sorted_until)
-        goto finish_sprite_frame;
-
-    // at least one thing in the list, sorted_until.
-    // invariant: everything is sorted until sorted_until.
-    // when we look at the next element in the list, submerge it back
-    // in the linked list until it goes where it is sorted.
-    while (1)
-    {   uint8_t sort_this = sorted_until;
-        // break the invariant to get the new tail of the list:
-        sorted_until = sprite[sort_this].next_to_draw;
-
-        // restore the invariant.
-        // this may update sprite[sort_this].next_to_draw which is why we grabbed it earlier.
-        sprite_push_back_to_sort(sort_this);
-
-        if (!sorted_until)
-        {   // no more sprites to be sorted
-            break;
+void test_sprite()
+{   // Sprite tests to make sure everything is working correctly.
+    {   // Overlapping sprites keep their order wherever the camera is
+        landscape_camera_x = 0;
+        landscape_camera_y = 0;
+        sprite_init();
+        uint8_t back = sprite_new(), front = sprite_new();
+        sprite[back].shape = Rectangle_TopHalfBottomHalf;
+        sprite[back].colors = 0x11;
+        sprite[back].width = sprite[back].height = 16;
+        sprite[front].shape = Rectangle_TopHalfBottomHalf;
+        sprite[front].colors = 0x22;
+        sprite[front].width = sprite[front].height = 16;
+        // small depths like these used to wrap around once the camera moved down:
+        sprite_move(back, 50, 50, sprite_depth(-200));
+        sprite_move(front, 58, 50, sprite_depth(-199));
+        const int16_t camera_y[] = {0, 9, 41, -100, 1};
+        for (size_t i = 0; i < sizeof(camera_y)/sizeof(camera_y[0]); ++i)
+        {   landscape_camera_y = camera_y[i];
+            int y = 54 - camera_y[i];
+            ASSERT(test_sprite_pixel(52, y, 0, 0) == sprite_palette[1]);
+            ASSERT(test_sprite_pixel(60, y, 0, 0) == sprite_palette[2]);
+            ASSERT(test_sprite_pixel(70, y, 0, 0) == sprite_palette[2]);
         }
+        landscape_camera_y = 0;
+        sprite_init();
     }
-
-finish_sprite_frame:
-    sprite[0].check_next_for_visible = sprite[0].next_to_draw;
-    sprite[0].next_visible = 0;
-    sprite[0].previous_visible = 0;
+    {   // Lines that don't get drawn (e.g. under the game message) don't lose or keep sprites
+        sprite_init();
+        uint8_t index = sprite_new();
+        sprite[index].shape = Rectangle_TopHalfBottomHalf;
+        sprite[index].colors = 0x33;
+        sprite[index].width = sprite[index].height = 16;
+        sprite_move(index, 50, 50, sprite_depth(-200));
+        // starts on a skipped line, still shows up below it:
+        ASSERT(test_sprite_pixel(52, 58, 45, 55) == sprite_palette[3]);
+        // ends on a skipped line, is gone below it:
+        ASSERT(test_sprite_pixel(52, 72, 60, 70) == 0);
+        sprite_init();
+    }
+    message("sprite tests passed!\n");
 }
+#endif
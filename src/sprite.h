@@ -2,78 +2,77 @@
 #define SPRITE_H
 
 #include <stdint.h>
+#include "game.h" // pixel_t
+#include "shapes.h" // sprite_shape_t, generated by mk_shapes.py
 
 #define MAX_SPRITES 128 // technically we use one (0) as the head of the linked list.
+// sprite iz is the world y something stands at (see landscape.h) in fixed point, starting a screen's
+// height above y = 0, so sprites at y from -SCREEN_H up to 65536/SPRITE_DEPTH_PER_PIXEL - SCREEN_H get ordered:
+#define SPRITE_DEPTH_PER_PIXEL 64
+#define SPRITE_RESORT_ALL_COUNT 16 // if more sprites change in a frame, sort all of them from scratch
+#ifndef SPRITE_LINE_LIMIT
+#define SPRITE_LINE_LIMIT 32 // most sprites which can be drawn on one vga_line
+#endif
 
-typedef enum
-{   // shape with coloring information after the underscore.
-    NoShape_Invisible,
-    Rectangle_TopHalfBottomHalf,
-    /* TODO
-    Rectangle_LeftRight,
-    Ellipse_TopHalfBottomHalf,
-    Ellipse_LeftRight,
-    Ellipse_DiagonalForwardSlash,
-    Ellipse_DiagonalBackSlash,
-    // E.g. for round shields:
-    Ellipse_ThickBorder,
-    Shield_ThickBorder,
-    SwordProfileAngle0_HandAndHilt,
-    SwordProfileAngle1_HandAndHilt,
-    SwordProfileAngle2_HandAndHilt,
-    SwordProfileAngle3_HandAndHilt,
-    SwordProfileAngle4_HandAndHilt,
-    SwordProfileAngle5_HandAndHilt,
-    SwordProfileAngle6_HandAndHilt,
-    SwordProfileAngle7_HandAndHilt,
-    SwordProfileAngle8_HandAndHilt,
-    SwordProfileAngle9_HandAndHilt,
-    SwordProfileAngleA_HandAndHilt,
-    SwordProfileAngleB_HandAndHilt,
-    SwordProfileAngleC_HandAndHilt,
-    SwordProfileAngleD_HandAndHilt,
-    SwordProfileAngleE_HandAndHilt,
-    SwordProfileAngleF_HandAndHilt,
-    */
-    // DO NOT USE PAST THIS POINT
-    ShapeCount,
-} sprite_shape_t;
+// sprite_frame() sorts sprites into one of two lists while sprite_line() draws the other (see
+// sprite_commit()), so some flags come in pairs: flag << 0 for the first list, flag << 1 for the second.
+#define SPRITE_DIRTY 1 // needs re-sorting the next time that list gets prepared
+#define SPRITE_SORTED 4 // on-screen, in that list's sorted order
+#define SPRITE_IN_USE 16 // between sprite_new() and sprite_free()
+#define SPRITE_NEAR 32 // within SPRITE_CULL_MARGIN of the screen, last time sprite_frame() looked
+// how far off-screen (in pixels) sprites still get looked at when the camera moves; sprites
+// further away only get looked at again once the camera moved this far, or they changed:
+#define SPRITE_CULL_MARGIN 64
 
-extern uint16_t sprite_palette[16];
+extern pixel_t sprite_palette[16];
 
 typedef struct sprite
 {   // struct holding sprite information for drawing on screen.
 
-    // 32 bits for linked list stuff:
-    // updated in sprite_line() and sprite_frame(), do not change outside of these.
-    uint8_t next_to_draw;       // linking sprites which should be drawn next -
-    uint8_t previous_to_draw;   // - as ordered from top to bottom (small iy to large iy)
-    uint8_t next_visible;       // linking sprites which are currently being drawn on this vga_line -
-    uint8_t previous_visible;   // - ordered in z (small z to big z)
-    // 32 bits:
-    float iz;    // for depth, whatever should be drawn first is lower in z.
-    // 32 bits:
+    // 32 bits for bookkeeping:
+    // updated in sprite_new(), sprite_free() and sprite_frame(), do not change outside of these.
+    uint8_t next_to_draw;       // linking all sprites in use -
+    uint8_t previous_to_draw;   // - in no particular order
+    uint16_t flags; // SPRITE_DIRTY etc.
+    // 16 bits:
+    uint16_t iz; // fixed-point depth in the world (see sprite_depth()), whatever should be drawn first is lower in z.
+    // 32 bits, top-left in the world (see landscape.h), the screen shows landscape_camera_x/y at its top-left:
     int16_t iy, ix;
     // 32 bits:
     uint8_t width, height;
+    uint8_t colors;  // first nibble for color1, second nibble for color2
     union
-    {   uint8_t colors;  // first nibble for color1, second nibble for color2
-        uint8_t check_next_for_visible; // only used in root sprite (sprite[0]).
-    };
-    union
-    {   uint8_t shape;
+    {   uint8_t shape; // sprite_shape_t, or sprite_bitmap_t (see bitmaps.h) to draw a bitmap at its own size
         uint8_t next_free; // next free sprite index, only used in the free (unused) list of sprites.
     };
-    // try to keep to 4x32 bits = 4x4 bytes = 16 bytes
+    // try to keep to 16 bytes or less
 } sprite_t;
 
 extern sprite_t sprite[MAX_SPRITES];
 
+// can be lowered at runtime (up to SPRITE_LINE_LIMIT) to see what content would fit in the line budget:
+extern uint8_t sprite_line_limit;
+// number of sprites dropped because a line had too many, and the most sprites seen on one line:
+extern uint32_t sprite_line_overflows;
+extern uint8_t sprite_line_peak;
+
+// sprite iz for something standing at world y:
+uint16_t sprite_depth(float y);
 uint8_t sprite_new();
 void sprite_free(uint8_t index);
+// call after changing ix, iy, iz, width, height or shape of sprite[index] directly,
+// or use sprite_move(), otherwise sprite_frame() won't notice:
+void sprite_changed(uint8_t index);
+void sprite_move(uint8_t index, int16_t ix, int16_t iy, uint16_t iz);
 
 void sprite_init();
 void sprite_line();
+// sprite_frame() can run any time after the sprites changed, sprite_commit() at the end of each frame:
 void sprite_frame();
+void sprite_commit();
+
+#ifdef EMULATOR
+void test_sprite();
+#endif
 
 #endif
@@ -0,0 +1,70 @@
+#include "bitbox.h"
+#include "cycles.h"
+#include "game.h"
+#include "task.h"
+
+task_queue_t task_frame CCM_MEMORY;
+task_queue_t task_line CCM_MEMORY;
+
+int task_start(task_queue_t *queue, task_step_t step)
+{   // adds a task to the queue (unless it's already there), returns 0 if the queue is full.
+    if (task_running(queue, step))
+        return 1;
+    if (queue->count >= TASK_SLOTS)
+    {   message("no room for another task\n");
+        return 0;
+    }
+    queue->step[queue->count++] = step;
+    return 1;
+}
+
+int task_running(const task_queue_t *queue, task_step_t step)
+{   // nonzero if the task is in the queue, i.e. not finished yet.
+    for (int i = 0; i < queue->count; ++i)
+        if (queue->step[i] == step)
+            return 1;
+    return 0;
+}
+
+static void task_remove(task_queue_t *queue, int i)
+{   // removes the task at i, keeping the others in order.
+    if (queue->next > i)
+        --queue->next;
+    --queue->count;
+    for (; i < queue->count; ++i)
+        queue->step[i] = queue->step[i+1];
+}
+
+void task_stop(task_queue_t *queue, task_step_t step)
+{   // removes the task from the queue without running it again.
+    for (int i = 0; i < queue->count; ++i)
+        if (queue->step[i] == step)
+            return task_remove(queue, i);
+}
+
+int task_run(task_queue_t *queue, uint32_t deadline)
+{   // runs steps of the queued tasks in turn, until the deadline (see cycles_now) passes
+    // or every task is idle.  Returns the number of steps which did some work.
+    int worked = 0;
+    int idle = 0; // tasks in a row which had nothing to do
+    while (queue->count && idle < queue->count && cycles_before(deadline))
+    {   if (queue->next >= queue->count)
+            queue->next = 0;
+        int i = queue->next++;
+        switch (queue->step[i]())
+        {   case TaskDone:
+                task_remove(queue, i);
+                idle = 0;
+                ++worked;
+                break;
+            case TaskMore:
+                idle = 0;
+                ++worked;
+                break;
+            case TaskIdle:
+                ++idle;
+                break;
+        }
+    }
+    return worked;
+}
@@ -0,0 +1,40 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdint.h>
+
+// A small cooperative scheduler for slow work that can be done a piece at a time.
+// A task is a step function, which does a small piece of work and says whether
+// there's more to do.  task_run() goes round the tasks of a queue, one step each,
+// until its cycle budget is spent; a step always runs to the end, so steps need to
+// be shorter than the budget they run in.
+//
+// task_frame runs in the main context at the end of game_frame(), so it can do IO.
+// task_line runs inside graph_line(), on the idle odd lines and in the time left
+// over after drawing even lines; its steps need to be interrupt safe, so set it up
+// once in game_init() and don't change it afterwards.
+#define TASK_SLOTS 4
+
+typedef enum
+{   TaskDone = 0, // the task is finished, and gets removed from the queue
+    TaskMore, // call again when there's time
+    TaskIdle, // nothing to do right now, but keep the task around
+} task_result_t;
+
+typedef task_result_t (*task_step_t)();
+
+typedef struct task_queue
+{   task_step_t step[TASK_SLOTS];
+    uint8_t count;
+    uint8_t next; // round-robin position
+} task_queue_t;
+
+extern task_queue_t task_frame;
+extern task_queue_t task_line;
+
+int task_start(task_queue_t *queue, task_step_t step);
+int task_running(const task_queue_t *queue, task_step_t step);
+void task_stop(task_queue_t *queue, task_step_t step);
+int task_run(task_queue_t *queue, uint32_t deadline);
+
+#endif
@@ -0,0 +1,185 @@
+#include "bitbox.h"
+#include "game.h"
+#include "text-cache.h"
+
+#include <string.h> // memset
+
+#define TEXT_CACHE_LINES 8
+#define TEXT_CACHE_GAP 16 // most pixels of background to draw between things, before starting a new span
+
+typedef enum
+{   TextCacheDirty = 0, // the editor draws the row, and it gets captured
+    TextCacheValid, // textCache_line() draws the row
+    TextCacheUncached, // the editor draws the row, it can't be cached until the signature changes
+} text_cache_state_t;
+
+typedef struct text_cache_span
+{   uint16_t x0, x1; // pixels [x0, x1), both even
+    // for even and odd columns, the color for a 0 bit and for a 1 bit:
+    pixel_t color[2][2];
+} text_cache_span_t;
+
+static uint32_t textCache_signature[TEXT_CACHE_ROWS] CCM_MEMORY;
+static uint8_t textCache_state[TEXT_CACHE_ROWS] CCM_MEMORY;
+static uint8_t textCache_span_count[TEXT_CACHE_ROWS] CCM_MEMORY;
+static text_cache_span_t textCache_span[TEXT_CACHE_ROWS][TEXT_CACHE_SPANS];
+static uint32_t textCache_bits[TEXT_CACHE_ROWS][TEXT_CACHE_LINES][SCREEN_W/32];
+// while capturing a row, the first color seen in each column, and the other color (if any):
+static pixel_t textCache_color[2][SCREEN_W];
+static int textCache_capture_row CCM_MEMORY;
+static uint8_t textCache_captured CCM_MEMORY; // a bit for each line of the row captured so far
+
+void textCache_reset()
+{   // forgets all rows, e.g. when switching to another editor.
+    memset(textCache_state, TextCacheDirty, sizeof(textCache_state));
+    textCache_capture_row = -1;
+}
+
+void textCache_sign(int row, uint32_t signature)
+{   // call every frame for every row, before drawing.
+    ASSERT(row >= 0 && row < TEXT_CACHE_ROWS);
+    if (signature == textCache_signature[row])
+        return;
+    textCache_signature[row] = signature;
+    textCache_state[row] = TextCacheDirty;
+}
+
+int textCache_line(int row, int y)
+{   // draws line y (0 to 7) of the text row from the cache, or returns 0 if the editor needs to.
+    ASSERT(row >= 0 && row < TEXT_CACHE_ROWS);
+    ASSERT(y >= 0 && y < TEXT_CACHE_LINES);
+    if (textCache_state[row] != TextCacheValid)
+        return 0;
+    const uint32_t *bits = textCache_bits[row][y];
+    const text_cache_span_t *span = textCache_span[row];
+    for (int s = 0; s < textCache_span_count[row]; ++s, ++span)
+    {   // two pixels for each two bits:
+        const pixel_pair_t pair[4] =
+        {   PIXEL_PAIR(span->color[0][0], span->color[1][0]),
+            PIXEL_PAIR(span->color[0][1], span->color[1][0]),
+            PIXEL_PAIR(span->color[0][0], span->color[1][1]),
+            PIXEL_PAIR(span->color[0][1], span->color[1][1]),
+        };
+        pixel_pair_t *dst = (pixel_pair_t *)draw_buffer + span->x0/2;
+        for (int x = span->x0; x < span->x1; x += 2)
+            *dst++ = pair[(bits[x/32] >> (x%32)) & 3];
+    }
+    return 1;
+}
+
+static int textCache_adopt(pixel_t color[2], int x)
+{   // makes sure the colors of column x are in a span's colors, or returns 0 if there's no room.
+    // a span with only one color so far has color[1] == color[0].
+    for (int i = 0; i < 2; ++i)
+    {   pixel_t c = textCache_color[i][x];
+        if (c == color[0] || c == color[1])
+            continue;
+        if (color[1] != color[0])
+            return 0;
+        color[1] = c;
+    }
+    return 1;
+}
+
+static void textCache_build(int row, pixel_t background)
+{   // splits the captured row into spans of columns that share their colors.
+    text_cache_span_t *span = textCache_span[row];
+    int count = 0;
+    int end = 0; // after the last column with something drawn in the current span
+    for (int x = 0; x < SCREEN_W; x += 2)
+    {   if
+        (   textCache_color[0][x] == background && textCache_color[1][x] == background &&
+            textCache_color[0][x+1] == background && textCache_color[1][x+1] == background
+        )
+            continue;
+        if (count)
+        {   // try to carry on the current span, drawing background over any gap:
+            pixel_t color[2][2];
+            memcpy(color, span[count-1].color, sizeof(color));
+            if
+            (   x - end <= TEXT_CACHE_GAP &&
+                (x == end || (textCache_adopt(color[0], end) && textCache_adopt(color[1], end + 1))) &&
+                textCache_adopt(color[0], x) && textCache_adopt(color[1], x + 1)
+            )
+            {   memcpy(span[count-1].color, color, sizeof(color));
+                end = x + 2;
+                continue;
+            }
+            span[count-1].x1 = end;
+        }
+        if (count == TEXT_CACHE_SPANS)
+        {   textCache_state[row] = TextCacheUncached;
+            return;
+        }
+        for (int parity = 0; parity < 2; ++parity)
+        {   span[count].color[parity][0] = textCache_color[0][x + parity];
+            span[count].color[parity][1] = textCache_color[1][x + parity];
+        }
+        span[count].x0 = x;
+        end = x + 2;
+        ++count;
+    }
+    if (count)
+        span[count-1].x1 = end;
+    textCache_span_count[row] = count;
+
+    // bits were set where a column differed from its first color; flip them
+    // where that first color is the span's color for a 1 bit:
+    for (int s = 0; s < count; ++s)
+    for (int x = span[s].x0; x < span[s].x1; ++x)
+    {   const pixel_t *color = span[s].color[x & 1];
+        if (color[1] == color[0] || textCache_color[0][x] != color[1])
+            continue;
+        for (int y = 0; y < TEXT_CACHE_LINES; ++y)
+            textCache_bits[row][y][x/32] ^= 1u << (x%32);
+    }
+    textCache_state[row] = TextCacheValid;
+}
+
+void textCache_capture(int row, int y, pixel_t background)
+{   // call after the editor drew line y (0 to 7) of a row that textCache_line() didn't draw.
+    // background is the color the editor cleared the row to.
+    ASSERT(row >= 0 && row < TEXT_CACHE_ROWS);
+    ASSERT(y >= 0 && y < TEXT_CACHE_LINES);
+    if (textCache_state[row] != TextCacheDirty)
+        return;
+    if (y == 0)
+    {   textCache_capture_row = row;
+        textCache_captured = 0;
+    }
+    else if (textCache_capture_row != row || textCache_captured != (1 << y) - 1)
+    {   // missed a line somehow, try again next frame.
+        return;
+    }
+
+    uint32_t *bits = textCache_bits[row][y];
+    for (int i = 0; i < SCREEN_W/32; ++i)
+    {   uint32_t word = 0;
+        for (int k = 0; k < 32; ++k)
+        {   int x = 32*i + k;
+            pixel_t c = draw_buffer[x];
+            if (y == 0)
+            {   textCache_color[0][x] = c;
+                textCache_color[1][x] = c;
+                continue;
+            }
+            if (c == textCache_color[0][x])
+                continue;
+            if (textCache_color[1][x] == textCache_color[0][x])
+                textCache_color[1][x] = c;
+            else if (c != textCache_color[1][x])
+            {   // more than two colors in one column.
+                textCache_state[row] = TextCacheUncached;
+                textCache_capture_row = -1;
+                return;
+            }
+            word |= 1u << k;
+        }
+        bits[i] = word;
+    }
+    textCache_captured |= 1 << y;
+    if (y == TEXT_CACHE_LINES - 1)
+    {   textCache_capture_row = -1;
+        textCache_build(row, background);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include "game.h" // pixel_t
+#include <stdint.h>
+
+// A cache for the text rows of the editors (10 lines each, starting at vga_line 16),
+// so rows showing the same thing as last frame don't need their messages rebuilt.
+// Only the 8 lines of text in each row get cached (the editors' internal_line 0 to 7);
+// each line is kept as a bit per pixel, plus the two colors of each span of pixels.
+//
+// Every frame, the editor gives each row a signature of everything that row shows.
+// While a row's signature stays the same, textCache_line() draws the row from the cache.
+// Otherwise the editor draws the line itself, and calls textCache_capture() afterwards.
+#define TEXT_CACHE_ROWS 20
+#define TEXT_CACHE_SPANS 8 // rows needing more spans than this always get drawn by the editor
+
+// starting signature, mix in values with textCache_mix():
+#define TEXT_CACHE_SIGNATURE 2166136261u
+
+static inline uint32_t textCache_mix(uint32_t signature, uint32_t value)
+{   // FNV-1a style, value should be something that fits in a byte or so.
+    return (signature ^ value) * 16777619u;
+}
+
+void textCache_reset();
+void textCache_sign(int row, uint32_t signature);
+int textCache_line(int row, int y);
+void textCache_capture(int row, int y, pixel_t background);
+
+#endif
@@ -0,0 +1,84 @@
+#include "bitbox.h"
+#include "game.h"
+#include "sprite.h"
+#include "tiles.h"
+
+#include <string.h> // memcpy
+
+#define TILES_ACROSS (SCREEN_W/TILE_SIZE + 1) // most tiles touching one vga_line, when scrolled
+
+uint8_t tiles_graphics[TILE_COUNT][TILE_SIZE][TILE_SIZE/2] CCM_MEMORY;
+uint8_t tiles_map[TILES_MAP_H][TILES_MAP_W] CCM_MEMORY;
+int16_t tiles_scroll_x CCM_MEMORY;
+int16_t tiles_scroll_y CCM_MEMORY;
+
+// both pixels of each possible byte of tiles_graphics, for one write into draw_buffer:
+static pixel_pair_t tiles_pair[256] CCM_MEMORY;
+// the sprite_palette that tiles_pair was built from:
+static pixel_t tiles_pair_palette[16] CCM_MEMORY;
+// scroll for the current frame, so that it can't change halfway down the screen:
+static int16_t tiles_frame_x CCM_MEMORY;
+static int16_t tiles_frame_y CCM_MEMORY;
+// graphics of the tiles across the map row in tiles_row_cached,
+// so they only need looking up once for all the lines of a tile row:
+static const uint8_t *tiles_row_cache[TILES_ACROSS] CCM_MEMORY;
+static int tiles_row_cached CCM_MEMORY;
+
+void tiles_init()
+{   // clears the map and graphics, call before setting them up.
+    STATIC_ASSERT((TILES_MAP_W & (TILES_MAP_W - 1)) == 0);
+    STATIC_ASSERT((TILES_MAP_H & (TILES_MAP_H - 1)) == 0);
+    STATIC_ASSERT(TILE_COUNT <= 256);
+    memset(tiles_graphics, 0, sizeof(tiles_graphics));
+    memset(tiles_map, 0, sizeof(tiles_map));
+    tiles_scroll_x = 0;
+    tiles_scroll_y = 0;
+    // make sure tiles_pair gets built in tiles_frame():
+    tiles_pair_palette[0] = ~sprite_palette[0];
+    tiles_frame();
+}
+
+void tiles_frame()
+{   // call once a frame, before any tiles_line().
+    if (memcmp(tiles_pair_palette, sprite_palette, sizeof(tiles_pair_palette)))
+    {   memcpy(tiles_pair_palette, sprite_palette, sizeof(tiles_pair_palette));
+        for (int i = 0; i < 256; ++i)
+            tiles_pair[i] = PIXEL_PAIR(sprite_palette[i & 15], sprite_palette[i >> 4]);
+    }
+    tiles_frame_x = tiles_scroll_x & (TILES_MAP_W*TILE_SIZE - 1);
+    tiles_frame_y = tiles_scroll_y & (TILES_MAP_H*TILE_SIZE - 1);
+    // the map may have changed:
+    tiles_row_cached = -1;
+}
+
+void tiles_line()
+{   // draws the background for this vga_line into all of draw_buffer.
+    int y = (tiles_frame_y + vga_line) & (TILES_MAP_H*TILE_SIZE - 1);
+    int map_row = y / TILE_SIZE;
+    if (map_row != tiles_row_cached)
+    {   int map_column = tiles_frame_x / TILE_SIZE;
+        for (int i = 0; i < TILES_ACROSS; ++i)
+            tiles_row_cache[i] = tiles_graphics[tiles_map[map_row][(map_column + i) & (TILES_MAP_W - 1)]][0];
+        tiles_row_cached = map_row;
+    }
+
+    // gather this line of each tile, then expand it two pixels at a time:
+    uint8_t line[TILES_ACROSS*TILE_SIZE/2 + 1];
+    int line_offset = (y % TILE_SIZE) * TILE_SIZE/2;
+    for (int i = 0; i < TILES_ACROSS; ++i)
+        memcpy(&line[i*TILE_SIZE/2], tiles_row_cache[i] + line_offset, TILE_SIZE/2);
+    line[TILES_ACROSS*TILE_SIZE/2] = 0;
+
+    int fine_x = tiles_frame_x % TILE_SIZE;
+    const uint8_t *src = &line[fine_x / 2];
+    pixel_pair_t *dst = (pixel_pair_t *)draw_buffer;
+    if (fine_x & 1)
+    {   // each pair of pixels straddles two bytes:
+        for (int i = 0; i < SCREEN_W/2; ++i)
+            dst[i] = tiles_pair[(src[i] >> 4) | ((src[i + 1] & 15) << 4)];
+    }
+    else
+    {   for (int i = 0; i < SCREEN_W/2; ++i)
+            dst[i] = tiles_pair[src[i]];
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+
+// A scrolling background of 16x16 tiles, with 4-bit pixels indexing into sprite_palette.
+#define TILE_SIZE 16
+#define TILE_COUNT 32
+#define TILES_MAP_W 32 // needs to be a power of 2, the map wraps around
+#define TILES_MAP_H 32 // needs to be a power of 2, the map wraps around
+
+// two pixels per byte, the left pixel in the low nibble:
+extern uint8_t tiles_graphics[TILE_COUNT][TILE_SIZE][TILE_SIZE/2];
+extern uint8_t tiles_map[TILES_MAP_H][TILES_MAP_W];
+// top-left of the screen in the map, in pixels:
+extern int16_t tiles_scroll_x, tiles_scroll_y;
+
+void tiles_init();
+void tiles_frame();
+void tiles_line();
+
+#endif